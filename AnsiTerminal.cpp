@@ -1,8 +1,25 @@
 #include "AnsiTerminal.h"
-
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+
+// Set by SIGWINCH, which also writes a byte to the pipe so a wait for input wakes up
+// even if the signal arrived while we were drawing
+static volatile sig_atomic_t windowResized = 0;
+static int resizePipe[2] = {-1, -1};
+
+static void onWindowResize(int)
+{
+    windowResized = 1;
+    char byte = 0;
+    if (write(resizePipe[1], &byte, 1) < 0) {
+        // Full pipe: a wakeup is already pending
+    }
+}
 
 // Constructor: Configure terminal for non-canonical mode
-AnsiTerminal::AnsiTerminal() {
+AnsiTerminal::AnsiTerminal() : inputStart(0), inputEnd(0) {
     // Save the original terminal settings
     tcgetattr(STDIN_FILENO, &original_tio);
     struct termios new_tio = original_tio;
@@ -10,25 +27,35 @@ AnsiTerminal::AnsiTerminal() {
     // Disable canonical mode and echo for real-time input reading
     new_tio.c_lflag &= ~(ICANON | ECHO);
     tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
+
+    if (resizePipe[0] < 0 && pipe(resizePipe) == 0) {
+        fcntl(resizePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(resizePipe[1], F_SETFL, O_NONBLOCK);
+    }
+    struct sigaction action = {};
+    action.sa_handler = onWindowResize;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGWINCH, &action, nullptr);
 }
 
 // Destructor: Restore the terminal settings to original state
 AnsiTerminal::~AnsiTerminal() {
+    flush();
     tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
 }
 
 // Method to print text at a specified position
 void AnsiTerminal::printAt(int row, int col, const std::string &text) {
-    std::cout << "\033[" << row << ";" << col << "H" << text.substr(0,col_width) << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H" << text.substr(0,col_width);
 }
 
-void AnsiTerminal::printAt(int row, int col, const std::string &text, int differ) { //Overloaded function for printing more than 9 characters
-    std::cout << "\033[" << row << ";" << col << "H" << text << std::flush;
+void AnsiTerminal::printAt(int row, int col, const std::string &text, int /*differ*/) { //Overloaded function for printing more than 9 characters
+    std::cout << "\033[" << row << ";" << col << "H" << text;
 }
 
 
 void AnsiTerminal::printAt(int row, int col, int value) {
-    std::cout << "\033[" << row << ";" << col << "H" << value << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H" << value;
 }
 
 void AnsiTerminal::printAt(int row, int col) {
@@ -37,48 +64,109 @@ void AnsiTerminal::printAt(int row, int col) {
         std::cout << "\033[" << row << ";" << col+i << "H"<< " ";
 
     // Reset color modes
-    std::cout << "\033[0m" << std::flush;
+    std::cout << "\033[0m";
 }
 
 void AnsiTerminal::printAt(int row, int col, char value) {
-    std::cout << "\033[" << row << ";" << col << "H" << value << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H" << value;
 }
 
 
 
 // Method to print text with inverted background at a specified position
 void AnsiTerminal::printInvertedAt(int row, int col, const std::string &text) {
-    std::cout << "\033[" << row << ";" << col << "H\033[7m" << text.substr(0,col_width) << "\033[0m" << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H\033[7m" << text.substr(0,col_width) << "\033[0m";
     // \033[7m enables reverse video mode, \033[0m resets to normal
 }
 
 
+void AnsiTerminal::printInvertedAt(int row, int col, const std::string &text, int /*differ*/) {
+    std::cout << "\033[" << row << ";" << col << "H\033[7m" << text << "\033[0m";
+}
+
 void AnsiTerminal::printInvertedAt(int row, int col, int value) {
-    std::cout << "\033[" << row << ";" << col << "H\033[7m" << value << "\033[0m" << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H\033[7m" << value << "\033[0m";
 }
 
 void AnsiTerminal::printInvertedAt(int row, int col, char value) {
-    std::cout << "\033[" << row << ";" << col << "H\033[7m" << value << "\033[0m" << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H\033[7m" << value << "\033[0m";
 }
 
 void AnsiTerminal::printInvertedAt(int row, int col) {
-    std::cout << "\033[" << row << ";" << col << "H\033[7m \033[0m" << std::flush;
+    std::cout << "\033[" << row << ";" << col << "H\033[7m \033[0m";
     // A space (" ") is written and only a white background is created with inverse color mode.
 }
 
 
 
 
+// Send everything printed since the last call to the terminal at once
+void AnsiTerminal::flush() {
+    std::cout << std::flush;
+}
+
 // Method to clear the terminal screen
 void AnsiTerminal::clearScreen() {
-    std::cout << "\033[2J\033[H" << std::flush; // Clear screen and move cursor to home
+    std::cout << "\033[2J\033[H"; // Clear screen and move cursor to home
+}
+
+bool AnsiTerminal::windowSize(int &rows, int &cols) {
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0)
+        return false;
+    rows = size.ws_row;
+    cols = size.ws_col;
+    return true;
+}
+
+// Take one byte of input, reading everything the terminal has buffered when we run out
+ssize_t AnsiTerminal::readByte(char &ch) {
+    if (inputStart == inputEnd) {
+        ssize_t count = read(STDIN_FILENO, input, sizeof(input));
+        if (count <= 0)
+            return count;
+        inputStart = 0;
+        inputEnd = count;
+    }
+    ch = input[inputStart++];
+    return 1;
+}
+
+bool AnsiTerminal::keyPending() {
+    if (inputStart != inputEnd)
+        return true;
+    struct pollfd stdinFd = {STDIN_FILENO, POLLIN, 0};
+    return poll(&stdinFd, 1, 0) > 0 && (stdinFd.revents & POLLIN);
+}
+
+// Wait until a key can be read or the window was resized; false after timeoutMs (-1: no limit)
+bool AnsiTerminal::waitForInput(int timeoutMs) {
+    if (inputStart != inputEnd || windowResized)
+        return true;
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {resizePipe[0], POLLIN, 0}};
+    int ready = poll(fds, resizePipe[0] >= 0 ? 2 : 1, timeoutMs);
+    return ready != 0 || windowResized; // Errors fall through to the read, which reports them
 }
 
 // Method to get a single keystroke from the terminal
 char AnsiTerminal::getKeystroke() {
     char ch;
-    read(STDIN_FILENO, &ch, 1);
-    
+    ssize_t count = 0;
+    while (true) {
+        waitForInput(-1);
+        if (windowResized) {
+            windowResized = 0;
+            char drained[64];
+            while (read(resizePipe[0], drained, sizeof(drained)) > 0) {
+            }
+            return KEY_RESIZE;
+        }
+        if ((count = readByte(ch)) == 1)
+            break;
+        if (count == 0 || errno != EINTR)
+            return '"'; // Input closed: save and exit
+    }
+
     // We check the possibility that the Enter key will appear as both '\x0A' (LF) and '\x0D' (CR)
     if (ch == '\x0A' || ch == '\x0D') {
         return '\n';  // Enter olarak kabul edip '\n' döndürüyoruz
@@ -97,18 +185,26 @@ char AnsiTerminal::getSpecialKey() {
 
     if (ch == '\033') {
         char next_ch;
-        if (read(STDIN_FILENO, &next_ch, 1) == 0) return '\033';
+        if (readByte(next_ch) != 1) return '\033';
 
         if (next_ch == '[') {
             char arrow_key;
-            if (read(STDIN_FILENO, &arrow_key, 1) == 1) {
+            if (readByte(arrow_key) == 1) {
                 switch (arrow_key) {
                     case 'A': return '\x18'; //Up
                     case 'B': return '\x19'; //Down
                     case 'C': return '\x1A'; //Left
                     case 'D': return '\x1B'; //Right
+                    case '5': // Page Up is "\033[5~", Page Down "\033[6~"
+                    case '6': {
+                        char tilde;
+                        if (readByte(tilde) == 1 && tilde == '~')
+                            return arrow_key == '5' ? KEY_PAGE_UP : KEY_PAGE_DOWN;
+                        break;
+                    }
                 }
             }
+            return '\0'; // A sequence we do not handle
         } else {
             return next_ch | 0x80;
         }
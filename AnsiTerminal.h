@@ -6,7 +6,10 @@
 
 #define INIT_ROW 21
 #define INIT_COLUMN 8
-#define NUMBER_OF_ALL_LETTERS 26
+
+#define KEY_RESIZE '\x1C'    // The terminal window changed size
+#define KEY_PAGE_UP '\x1D'
+#define KEY_PAGE_DOWN '\x1E'
 
 #include <iostream>
 #include <vector>
@@ -15,6 +18,7 @@
 #include <algorithm>
 #include <unistd.h>  // For read()
 #include <termios.h> // For terminal control
+#include <sys/ioctl.h> // For the window size
 
 class AnsiTerminal
 {
@@ -52,18 +56,39 @@ public:
     // Print text with inverted background at a specified row and column
     void printInvertedAt(int row, int col, const std::string &text);
 
+    // Print text with inverted background (all characters)
+    void printInvertedAt(int row, int col, const std::string &text, int differ);
+
+    // Size of the terminal window; false if the output is not a terminal
+    bool windowSize(int &rows, int &cols);
+
     // Clear the terminal screen
     void clearScreen();
 
+    // Printing is buffered; show everything printed so far
+    void flush();
+
+    // True if more keys were already typed or pasted, so the next getSpecialKey does not block
+    bool keyPending();
+
+    // Wait until a key or a window resize is ready for getSpecialKey; false once timeoutMs
+    // passed without one (-1 waits as long as it takes)
+    bool waitForInput(int timeoutMs);
+
     // Get a single keystroke from the terminal
     char getKeystroke();
 
     // Get the arrow key or special key input ('\x18', '\x19', '\x1A', '\x1B' for Up, Down, Left, Right)
     // or detect other key combinations such as Alt+Key, Ctrl+Key, etc.
+    // Page Up/Down and a window resize come as KEY_PAGE_UP, KEY_PAGE_DOWN and KEY_RESIZE,
+    // other escape sequences as '\0'.
     char getSpecialKey();
 
 private:
     struct termios original_tio; // Holds the original terminal settings
+    char input[4096];            // Bytes read from the terminal but not yet returned as keys
+    size_t inputStart, inputEnd;
+    ssize_t readByte(char &ch);
 };
 
 #endif // ANSI_TERMINAL_H
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "autosave.h"
+#include "celladdress.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+    void appendEscaped(std::string &out, const std::string &text)
+    {
+        for (char ch : text)
+        {
+            if (ch == '\\' || ch == '\t' || ch == '\n')
+            {
+                out += '\\';
+                ch = ch == '\t' ? 't' : ch == '\n' ? 'n' : ch;
+            }
+            out += ch;
+        }
+    }
+
+    void appendRecord(std::string &out, int row, int col, const Cell &cell)
+    {
+        bool formula = !cell.getexpression().empty() && cell.getexpression()[0] == '=';
+        out += std::to_string(row);
+        out += '\t';
+        out += std::to_string(col);
+        out += '\t';
+        appendEscaped(out, cell.getexpression());
+        out += '\t';
+        if (!formula)
+            appendEscaped(out, cell.getvalue()); // Formula results are recomputed on recovery
+        out += '\n';
+    }
+
+    // Split one record into its four fields, undoing the escapes
+    bool parseRecord(const std::string &line, int &row, int &col, std::string &expression, std::string &value)
+    {
+        std::string fields[4];
+        int field = 0;
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            char ch = line[i];
+            if (ch == '\t')
+            {
+                if (++field > 3)
+                    return false;
+                continue;
+            }
+            if (ch == '\\' && i + 1 < line.size())
+            {
+                ch = line[++i];
+                ch = ch == 't' ? '\t' : ch == 'n' ? '\n' : ch;
+            }
+            fields[field] += ch;
+        }
+        if (field != 3)
+            return false;
+        row = atoi(fields[0].c_str());
+        col = atoi(fields[1].c_str());
+        expression.swap(fields[2]);
+        value.swap(fields[3]);
+        return row >= 0 && col >= 0 && row < MAX_ROWS && col < MAX_COLUMNS;
+    }
+
+    bool writeAll(int fd, const std::string &data)
+    {
+        for (size_t written = 0; written < data.size();)
+        {
+            ssize_t length = write(fd, data.data() + written, data.size() - written);
+            if (length < 0 && errno != EINTR)
+                return false;
+            if (length > 0)
+                written += length;
+        }
+        return true;
+    }
+}
+
+Autosave::Autosave(Spreadsheet &target, const std::string &base, int intervalSeconds)
+    : sheet(target), logPath(base + ".wal"), snapshotPath(base + ".snap"),
+      interval(std::chrono::seconds(intervalSeconds)), lastSave(std::chrono::steady_clock::now()),
+      logFd(-1), records(0), compacting(false), compactionDue(false)
+{
+    sheet.setJournaling(true);
+}
+
+Autosave::~Autosave()
+{
+    save();
+    if (compactor.joinable())
+    {
+        compactor.join();
+    }
+    if (logFd >= 0)
+    {
+        close(logFd);
+    }
+    sheet.setJournaling(false);
+}
+
+void Autosave::openLog()
+{
+    logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+bool Autosave::recover()
+{
+    bool restored = false;
+    int rows = sheet.totalrows, cols = sheet.totalcols;
+    std::string line, expression, value;
+    int row, col;
+
+    // The snapshot holds every non-empty cell, so it replaces what was loaded: a cell
+    // cleared before the compaction must not get its value from the file back
+    if (std::ifstream(snapshotPath).is_open())
+    {
+        sheet.start(sheet.totalrows, sheet.totalcols);
+        restored = true;
+    }
+
+    // The snapshot first, then a log being compacted when we stopped, then the current log
+    for (const std::string &path : {snapshotPath, logPath + ".old", logPath})
+    {
+        std::ifstream file(path);
+        while (getline(file, line))
+        {
+            if (!parseRecord(line, row, col, expression, value))
+                continue; // A record cut short by the crash
+            if (row >= rows || col >= cols)
+            {
+                rows = std::max(rows, row + 1);
+                cols = std::max(cols, col + 1);
+                sheet.resizes(rows, cols);
+            }
+            Cell &cell = sheet.getCell(row, col);
+            cell.setexpression(expression);
+            cell.setvalue(value);
+            restored = true;
+        }
+    }
+    sheet.totalrows = rows;
+    sheet.totalcols = cols;
+
+    std::vector<CellAddress> replayed;
+    sheet.takeJournal(replayed); // Already on disk
+    return restored;
+}
+
+void Autosave::tick()
+{
+    if (std::chrono::steady_clock::now() - lastSave >= interval)
+    {
+        save();
+    }
+}
+
+int Autosave::millisecondsToSave() const
+{
+    auto left = lastSave + interval - std::chrono::steady_clock::now();
+    return (int)std::max<long long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(left).count());
+}
+
+void Autosave::save()
+{
+    lastSave = std::chrono::steady_clock::now();
+    std::vector<CellAddress> edits;
+    compactionDue = sheet.takeJournal(edits) || compactionDue;
+    if (compactionDue && !compacting)
+    {
+        compactionDue = false;
+        startCompaction(); // Too much changed to list: write everything instead
+        return;
+    }
+    if (edits.empty())
+    {
+        return;
+    }
+
+    std::string data;
+    const Spreadsheet &view = sheet;
+    for (const CellAddress &address : edits)
+    {
+        const Cell *cell = view.findCell(address.row(), address.column());
+        if (cell)
+            appendRecord(data, address.row(), address.column(), *cell);
+    }
+    if (logFd < 0)
+    {
+        openLog();
+    }
+    if (logFd >= 0 && writeAll(logFd, data))
+    {
+        fdatasync(logFd);
+    }
+    records += (long)edits.size();
+    if (records >= COMPACT_AFTER_RECORDS)
+    {
+        startCompaction();
+    }
+}
+
+// Freeze the sheet, start a new log and write the frozen state out on another thread.
+// Until the snapshot is in place the previous log stays as <base>.wal.old.
+void Autosave::startCompaction()
+{
+    if (compacting)
+    {
+        compactionDue = true; // Start it once the running one is done
+        return;
+    }
+    if (compactor.joinable())
+    {
+        compactor.join();
+    }
+    if (logFd >= 0)
+    {
+        close(logFd);
+        logFd = -1;
+    }
+    std::string oldLog = logPath + ".old";
+    rename(logPath.c_str(), oldLog.c_str());
+    records = 0;
+
+    compacting = true;
+    SheetSnapshot frozen = sheet.snapshot();
+    std::string snapshotFile = snapshotPath;
+    compactor = std::thread([this, frozen, snapshotFile, oldLog]() {
+        std::string data, temporary = snapshotFile + ".tmp";
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0;
+        for (int i = 0; ok && i < frozen.totalrows; i++)
+        {
+            const std::vector<Cell> &row = frozen.getRow(i);
+            for (int j = 0; j < (int)row.size() && j < frozen.totalcols; j++)
+            {
+                if (!row[j].getvalue().empty() || !row[j].getexpression().empty())
+                    appendRecord(data, i, j, row[j]);
+            }
+            if (data.size() > (1 << 20))
+            {
+                ok = writeAll(fd, data);
+                data.clear();
+            }
+        }
+        ok = ok && writeAll(fd, data) && fdatasync(fd) == 0;
+        if (fd >= 0)
+            close(fd);
+        if (ok && rename(temporary.c_str(), snapshotFile.c_str()) == 0)
+            unlink(oldLog.c_str());
+        compacting = false;
+    });
+}
+
+void Autosave::discard()
+{
+    if (compactor.joinable())
+    {
+        compactor.join();
+    }
+    if (logFd >= 0)
+    {
+        close(logFd);
+        logFd = -1;
+    }
+    // Stop logging and drop a pending full save, so the destructor writes nothing back
+    sheet.setJournaling(false);
+    compactionDue = false;
+    records = 0;
+    unlink(logPath.c_str());
+    unlink((logPath + ".old").c_str());
+    unlink(snapshotPath.c_str());
+}
@@ -0,0 +1,42 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "sheet.h"
+
+#define COMPACT_AFTER_RECORDS 100000 // Log records written before the log is folded into a snapshot
+
+// Crash protection for one sheet. Every interval the cells edited since the last save are
+// appended to <base>.wal. Once the log is long, a background thread writes the whole sheet
+// to <base>.snap from a snapshot and the log starts over. recover() loads the snapshot in
+// place of the sheet's contents and replays the logs. Records are "row<TAB>col<TAB>expression<TAB>value", escaped.
+class Autosave
+{
+private:
+    Spreadsheet &sheet;
+    std::string logPath, snapshotPath;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point lastSave;
+    int logFd;
+    long records; // Written to the current log
+    std::thread compactor;
+    std::atomic<bool> compacting;
+    bool compactionDue; // A full save was asked for while a compaction was running
+
+    void openLog();
+    void startCompaction();
+
+public:
+    Autosave(Spreadsheet &target, const std::string &base, int intervalSeconds = 5);
+    ~Autosave(); // Saves what is left and waits for a running compaction
+
+    bool recover(); // Call before editing; true if anything was restored. Recalculate afterwards.
+    void tick();    // Call often; saves once the interval has passed
+    int millisecondsToSave() const; // Until tick() saves, 0 if it is due
+    void save();    // Append the edits now
+    void discard(); // Remove the files after a clean exit; nothing is saved after this
+};
+
+#endif
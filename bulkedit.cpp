@@ -0,0 +1,174 @@
+#include "bulkedit.h"
+#include "formulaparser.h"
+#include "workbook.h"
+#include <stdexcept>
+
+// Reject a cell outside the grid before anything is staged, so commit() never fails halfway
+static void checkInGrid(int row, int col)
+{
+    if (row < 0 || row >= MAX_ROWS || col < 0 || col >= MAX_COLUMNS)
+    {
+        throw std::out_of_range("Cell index out of bounds");
+    }
+}
+
+void BulkEdit::setCell(int row, int col, const std::string &text)
+{
+    checkInGrid(row, col);
+    CellAddress address(row, col);
+    auto inserted = staged.insert({address.key(), text});
+    if (inserted.second)
+    {
+        order.push_back(address);
+    }
+    else
+    {
+        inserted.first->second = text; // The last edit of a cell wins
+    }
+}
+
+void BulkEdit::setRange(const CellAddress &topLeft, const std::vector<std::vector<std::string>> &rows)
+{
+    if (rows.empty())
+    {
+        return;
+    }
+    size_t width = 0;
+    for (const std::vector<std::string> &row : rows)
+    {
+        width = std::max(width, row.size());
+    }
+    checkInGrid(topLeft.row(), topLeft.column());
+    checkInGrid(topLeft.row() + (int)rows.size() - 1, topLeft.column() + std::max((int)width, 1) - 1);
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        for (size_t j = 0; j < rows[i].size(); j++)
+        {
+            setCell(topLeft.row() + (int)i, topLeft.column() + (int)j, rows[i][j]);
+        }
+    }
+}
+
+void BulkEdit::clearRange(const CellRange &range)
+{
+    checkInGrid(range.first.row(), range.first.column());
+    checkInGrid(range.last.row(), range.last.column());
+    for (int i = range.first.row(); i <= range.last.row(); i++)
+    {
+        for (int j = range.first.column(); j <= range.last.column(); j++)
+        {
+            setCell(i, j, "");
+        }
+    }
+}
+
+std::string BulkEdit::inputAt(int row, int col) const
+{
+    auto found = staged.find(CellAddress(row, col).key());
+    if (found != staged.end())
+    {
+        return found->second;
+    }
+    const Cell *cell = static_cast<const Spreadsheet &>(sheet).findCell(row, col);
+    if (!cell)
+    {
+        return "";
+    }
+    const std::string &expression = cell->getexpression();
+    return !expression.empty() && expression[0] == '=' ? expression : cell->getvalue();
+}
+
+void BulkEdit::fill(const CellRange &range, bool down)
+{
+    checkInGrid(range.first.row(), range.first.column());
+    checkInGrid(range.last.row(), range.last.column());
+    int count = down ? range.last.row() - range.first.row() : range.last.column() - range.first.column();
+    int width = down ? range.last.column() - range.first.column() : range.last.row() - range.first.row();
+    for (int k = 0; k <= width; k++)
+    {
+        int sourceRow = down ? range.first.row() : range.first.row() + k;
+        int sourceCol = down ? range.first.column() + k : range.first.column();
+        std::string source = inputAt(sourceRow, sourceCol);
+
+        for (int step = 1; step <= count; step++)
+        {
+            int rowOffset = down ? step : 0, colOffset = down ? 0 : step;
+            std::string text = source;
+            if (!text.empty() && text[0] == '=')
+            {
+                // Relative references move with the cell, "$" parts stay fixed
+                text = rewriteReferences(source, [&](const CellAddress &address, std::string_view, bool) {
+                    return CellAddress(address.absoluteRow() ? address.row() : address.row() + rowOffset,
+                                       address.absoluteColumn() ? address.column() : address.column() + colOffset,
+                                       address.absoluteRow(), address.absoluteColumn());
+                });
+            }
+            setCell(sourceRow + rowOffset, sourceCol + colOffset, text);
+        }
+    }
+}
+
+void BulkEdit::fillDown(const CellRange &range)
+{
+    fill(range, true);
+}
+
+void BulkEdit::fillRight(const CellRange &range)
+{
+    fill(range, false);
+}
+
+void BulkEdit::commit()
+{
+    if (order.empty())
+    {
+        return;
+    }
+
+    // Grow the grid once for the whole batch
+    int rows = sheet.totalrows, cols = sheet.totalcols;
+    for (const CellAddress &address : order)
+    {
+        rows = std::max(rows, address.row() + 1);
+        cols = std::max(cols, address.column() + 1);
+    }
+    if (rows > sheet.totalrows || cols > sheet.totalcols)
+    {
+        sheet.resizes(rows, cols);
+        sheet.totalrows = rows;
+        sheet.totalcols = cols;
+    }
+
+    for (const CellAddress &address : order)
+    {
+        const std::string &text = staged[address.key()];
+        Cell &cell = sheet.getCell(address.row(), address.column());
+        if (!text.empty() && text[0] == '=')
+        {
+            cell.setexpression(text);
+            cell.setvalue(""); // Filled in by the recalculation below
+        }
+        else
+        {
+            cell.setexpression("");
+            cell.setvalue(text);
+        }
+    }
+
+    if (workbook)
+    {
+        workbook->recalculate(sheet, order);
+    }
+    else
+    {
+        formulaparser().recalculate(sheet, order);
+        sheet.clearDirty();
+    }
+    rollback();
+}
+
+void BulkEdit::rollback()
+{
+    order.clear();
+    staged.clear();
+}
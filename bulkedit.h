@@ -0,0 +1,44 @@
+#ifndef BULKEDIT_H
+#define BULKEDIT_H
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sheet.h"
+#include "celladdress.h"
+
+class Workbook;
+
+// Stages edits to one sheet and applies them together on commit(), followed by a
+// single recalculation of only the formulas that depend on the edited cells.
+// Text starting with '=' is stored as a formula, anything else as a value.
+// Staging a cell outside the grid throws std::out_of_range and stages nothing of that call,
+// so every edit that reaches commit() can be applied.
+class BulkEdit
+{
+private:
+    Spreadsheet &sheet;
+    Workbook *workbook; // Needed so sheets reading this one are updated too, may be null
+    std::vector<CellAddress> order; // Staged cells, first-edited first
+    std::unordered_map<std::uint64_t, std::string> staged;
+
+    std::string inputAt(int row, int col) const; // Staged text, or what the user entered
+    void fill(const CellRange &range, bool down);
+
+public:
+    BulkEdit(Spreadsheet &target, Workbook *book = nullptr) : sheet(target), workbook(book) {}
+
+    void setCell(int row, int col, const std::string &text);
+    // Set a rectangle starting at topLeft, one vector per row
+    void setRange(const CellAddress &topLeft, const std::vector<std::vector<std::string>> &rows);
+    // Copy the top row (fillDown) or left column (fillRight) over the rest of the range,
+    // shifting relative references as they move
+    void fillDown(const CellRange &range);
+    void fillRight(const CellRange &range);
+    void clearRange(const CellRange &range);
+
+    int size() const { return (int)order.size(); }
+    void commit();   // Apply every staged edit, then recalculate once
+    void rollback(); // Drop every staged edit
+};
+
+#endif
@@ -1,18 +1,97 @@
 #include "cell.h"
+#include "numberformat.h"
+#include "formulafunctions.h"
+#include <cctype>
+#include <cstring>
+
+Formula::Formula(std::string formula) : text(std::move(formula))
+{
+    if (text.empty() || text[0] != '=')
+    {
+        return; // Typed input, never evaluated
+    }
+    size_t pos = 1; // Calls are only looked for after the '=' and after the previous call
+    for (size_t open = text.find('(', pos); open != std::string::npos; open = text.find('(', open + 1))
+    {
+        // The function name is the longest run of letters before '(' naming a known function
+        size_t nameStart = open;
+        while (nameStart > pos && open - nameStart < MAX_FUNCTION_NAME && isalpha((unsigned char)text[nameStart - 1]))
+            nameStart--;
+        const FunctionInfo *function = nullptr;
+        for (; nameStart < open && !function; nameStart++)
+            function = findFunction(std::string_view(text).substr(nameStart, open - nameStart));
+        if (!function)
+            continue;
+        nameStart--;
+
+        // Find matching closing parenthesis
+        size_t close = open;
+        int parenCount = 1;
+        while (parenCount > 0 && ++close < text.length())
+        {
+            if (text[close] == '(')
+                parenCount++;
+            if (text[close] == ')')
+                parenCount--;
+        }
+        if (parenCount > 0)
+            break; // Mismatched parentheses; the rest is left as written
+
+        calls.push_back({nameStart, open, close, function});
+        pos = close + 1;
+        open = close;
+    }
+}
 
-// Const version of getvalue()
 const std::string &Cell::getvalue() const
 {
     return value;
 }
 
-// Non-const version of getvalue() to modify the value
-std::string &Cell::getvalue()
+void Cell::setexpression(std::string formula)
 {
-    return value;
+    if (formula.empty())
+        expression.reset();
+    else
+        expression = std::make_shared<const Formula>(std::move(formula)); // A new formula drops the old calls
+}
+
+const std::string &Cell::getexpression() const
+{
+    static const std::string none;
+    return expression ? expression->text : none;
+}
+
+// Set a value parsed by the caller, e.g. a CSV column already known to be numeric
+void Cell::setvalue(std::string_view val, double num)
+{
+    value.assign(val.data(), val.size());
+    computed = false;
+    numeric = true;
+    number = num;
 }
 
 void Cell::setvalue(const std::string &val)
 {
     value = val;
+    computed = false;
+    numeric = parseWholeNumber(value, number);
+    if (!numeric && !parseNumber(value, number))
+    {
+        number = 0.0; // Text reads as zero in formulas
+    }
+}
+
+// Store a formula result; the display text is only rebuilt when the result changes
+bool Cell::setnumber(double num)
+{
+    if (computed && std::memcmp(&number, &num, sizeof(double)) == 0)
+    {
+        return false;
+    }
+    number = num;
+    value = formatNumber(num);
+    computed = true;
+    numeric = true;
+    return true;
 }
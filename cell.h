@@ -1,18 +1,46 @@
 #ifndef CELL_H
 #define CELL_H
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+struct FunctionInfo;
+
+// Formula text, with its function calls found when it is set rather than on every evaluation
+struct Formula
+{
+    struct Call
+    {
+        size_t nameStart, open, close; // Positions in text of the name, its '(' and the matching ')'
+        const FunctionInfo *function;
+    };
+
+    std::string text;
+    std::vector<Call> calls; // Left to right; calls inside another call's arguments are not listed
+
+    explicit Formula(std::string formula);
+};
+
 class Cell
 {
 private:
-    std::string value;
-    std::string expression;
+    std::string value;      // Display text; for computed cells it is formatted once per new result
+    std::shared_ptr<const Formula> expression; // Null for the many cells without one; copies share it
+    double number = 0.0;    // value parsed once when it is set
+    bool computed = false;  // value was produced by setnumber()
+    bool numeric = false;   // value is a number and nothing else
 
 public:
-    std::string &getvalue();
-    void setexpression(std::string formula) { expression = formula; }
-    const std::string &getexpression() const { return expression; }
+    void setexpression(std::string formula);
+    const std::string &getexpression() const;
+    std::shared_ptr<const Formula> getformula() const { return expression; }
     const std::string &getvalue() const;
+    double getnumber() const { return number; }
+    bool isnumber() const { return numeric; }
     void setvalue(const std::string &val);
+    void setvalue(std::string_view val, double num); // val is known to read as exactly num and nothing else
+    bool setnumber(double num); // false if the cell already held this result
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "celladdress.h"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && isspace((unsigned char)text.front()))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && isspace((unsigned char)text.back()))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    struct ColumnNameTable
+    {
+        char names[MAX_COLUMNS][3];
+        unsigned char lengths[MAX_COLUMNS];
+
+        ColumnNameTable()
+        {
+            for (int col = 0; col < MAX_COLUMNS; col++)
+            {
+                char reversed[3];
+                int length = 0;
+                for (int n = col + 1; n > 0; n = (n - 1) / 26)
+                {
+                    reversed[length++] = 'A' + (n - 1) % 26;
+                }
+                for (int i = 0; i < length; i++)
+                {
+                    names[col][i] = reversed[length - 1 - i];
+                }
+                lengths[col] = length;
+            }
+        }
+    };
+
+    const ColumnNameTable &columnNames()
+    {
+        static const ColumnNameTable table;
+        return table;
+    }
+}
+
+std::string_view columnName(int col)
+{
+    if (col < 0 || col >= MAX_COLUMNS)
+    {
+        return std::string_view();
+    }
+    const ColumnNameTable &table = columnNames();
+    return std::string_view(table.names[col], table.lengths[col]);
+}
+
+int columnIndex(std::string_view letters)
+{
+    if (letters.empty() || letters.size() > 3)
+    {
+        return -1;
+    }
+    int colIndex = 0;
+    for (char ch : letters)
+    {
+        if (ch >= 'a' && ch <= 'z')
+        {
+            ch -= 'a' - 'A';
+        }
+        if (ch < 'A' || ch > 'Z')
+        {
+            return -1;
+        }
+        colIndex = colIndex * 26 + (ch - 'A' + 1); // Convert 'A' to 1, 'B' to 2, etc.
+    }
+    return colIndex <= MAX_COLUMNS ? colIndex - 1 : -1;
+}
+
+size_t CellAddress::parse(std::string_view text, CellAddress &result)
+{
+    size_t pos = 0;
+    bool absoluteCol = pos < text.size() && text[pos] == '$';
+    if (absoluteCol)
+    {
+        pos++;
+    }
+
+    size_t colStart = pos;
+    while (pos < text.size() && isalpha((unsigned char)text[pos]))
+    {
+        pos++;
+    }
+    int col = columnIndex(text.substr(colStart, pos - colStart));
+
+    bool absoluteRow = pos < text.size() && text[pos] == '$';
+    if (absoluteRow)
+    {
+        pos++;
+    }
+
+    size_t rowStart = pos;
+    long long row = 0;
+    while (pos < text.size() && isdigit((unsigned char)text[pos]) && row <= MAX_ROWS)
+    {
+        row = row * 10 + (text[pos] - '0');
+        pos++;
+    }
+
+    if (col < 0 || pos == rowStart || row < 1 || row > MAX_ROWS)
+    {
+        return 0;
+    }
+    result = CellAddress((int)row - 1, col, absoluteRow, absoluteCol);
+    return pos;
+}
+
+std::string CellAddress::toString() const
+{
+    std::string text;
+    if (absoluteColumn())
+    {
+        text += '$';
+    }
+    text += columnName(column());
+    if (absoluteRow())
+    {
+        text += '$';
+    }
+    text += std::to_string(row() + 1);
+    return text;
+}
+
+bool CellRange::parse(std::string_view text, CellRange &result)
+{
+    size_t separator = text.find("..");
+    if (separator == std::string_view::npos)
+    {
+        return false;
+    }
+
+    CellAddress start, end;
+    std::string_view startText = trim(text.substr(0, separator));
+    std::string_view endText = trim(text.substr(separator + 2));
+    if (startText.empty() || CellAddress::parse(startText, start) != startText.size() ||
+        endText.empty() || CellAddress::parse(endText, end) != endText.size())
+    {
+        return false;
+    }
+
+    result.first = CellAddress(std::min(start.row(), end.row()), std::min(start.column(), end.column()),
+                               start.absoluteRow(), start.absoluteColumn());
+    result.last = CellAddress(std::max(start.row(), end.row()), std::max(start.column(), end.column()),
+                              end.absoluteRow(), end.absoluteColumn());
+    return true;
+}
+
+bool isSheetName(std::string_view name)
+{
+    if (name.empty() || !isalpha((unsigned char)name[0]))
+    {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](char ch) { return isalnum((unsigned char)ch) != 0; });
+}
+
+void forEachReference(std::string_view formula,
+                      const std::function<void(size_t pos, size_t length, const CellAddress &address,
+                                               std::string_view sheet, bool corner)> &visit)
+{
+    std::string_view sheet;
+    bool secondCorner = false; // The previous reference was followed by ".."
+    std::string_view rangeSheet;
+    size_t pos = 0;
+    while (pos < formula.size())
+    {
+        char ch = formula[pos];
+        if (ch == '"')
+        {
+            size_t close = formula.find('"', pos + 1); // Quoted text holds no references
+            pos = close == std::string_view::npos ? formula.size() : close + 1;
+            sheet = std::string_view();
+            secondCorner = false;
+            continue;
+        }
+        if (!isalnum((unsigned char)ch) && ch != '$')
+        {
+            if (ch != '!')
+            {
+                sheet = std::string_view(); // A sheet name only qualifies the reference right after it
+            }
+            pos++;
+            continue;
+        }
+
+        // Take the whole word so "SUM" or the "E5" of "1E5" is never read as a reference
+        size_t end = pos;
+        while (end < formula.size() && (isalnum((unsigned char)formula[end]) || formula[end] == '$'))
+        {
+            end++;
+        }
+        std::string_view word = formula.substr(pos, end - pos);
+
+        CellAddress address;
+        if (end < formula.size() && formula[end] == '!')
+        {
+            sheet = word;
+        }
+        else
+        {
+            if (!isdigit((unsigned char)ch) && CellAddress::parse(word, address) == word.size())
+            {
+                bool firstCorner = formula.compare(end, 2, "..") == 0;
+                if (secondCorner)
+                {
+                    sheet = rangeSheet; // "Sheet2!A1..B9" names the sheet once for both corners
+                }
+                visit(pos, word.size(), address, sheet, firstCorner || secondCorner);
+                secondCorner = firstCorner;
+                rangeSheet = sheet;
+            }
+            else
+            {
+                secondCorner = false;
+            }
+            sheet = std::string_view();
+        }
+        pos = end;
+    }
+}
+
+std::string rewriteReferences(std::string_view formula,
+                              const std::function<CellAddress(const CellAddress &address, std::string_view sheet,
+                                                              bool corner)> &map)
+{
+    std::string result;
+    size_t copied = 0;
+    forEachReference(formula, [&](size_t pos, size_t length, const CellAddress &address, std::string_view sheet, bool corner) {
+        result.append(formula.substr(copied, pos - copied));
+        CellAddress mapped = map(address, sheet, corner);
+        if (mapped.row() < 0 || mapped.row() >= MAX_ROWS || mapped.column() < 0 || mapped.column() >= MAX_COLUMNS)
+        {
+            result += "#REF!";
+        }
+        else
+        {
+            result += mapped.toString();
+        }
+        copied = pos + length;
+    });
+    result.append(formula.substr(copied));
+    return result;
+}
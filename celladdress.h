@@ -0,0 +1,78 @@
+#ifndef CELLADDRESS_H
+#define CELLADDRESS_H
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#define MAX_COLUMNS 16384 // A..XFD
+#define MAX_ROWS 1048576
+
+// A cell position packed in one 64-bit word: row in the low 32 bits,
+// column in the next 24 and the '$' flags of A1 notation on top
+class CellAddress
+{
+private:
+    std::uint64_t packed;
+
+    static const std::uint64_t ABSOLUTE_ROW = 1ull << 62;
+    static const std::uint64_t ABSOLUTE_COL = 1ull << 63;
+
+public:
+    CellAddress() : packed(0) {}
+    CellAddress(int row, int col, bool absoluteRow = false, bool absoluteCol = false)
+        : packed((std::uint64_t)(std::uint32_t)row | (std::uint64_t)(col & 0xFFFFFF) << 32 |
+                 (absoluteRow ? ABSOLUTE_ROW : 0) | (absoluteCol ? ABSOLUTE_COL : 0)) {}
+
+    int row() const { return (int)(std::uint32_t)packed; }
+    int column() const { return (int)((packed >> 32) & 0xFFFFFF); }
+    bool absoluteRow() const { return packed & ABSOLUTE_ROW; }
+    bool absoluteColumn() const { return packed & ABSOLUTE_COL; }
+    std::uint64_t key() const { return packed & ~(ABSOLUTE_ROW | ABSOLUTE_COL); } // Position only, for hashing
+
+    bool operator==(const CellAddress &other) const { return key() == other.key(); }
+    bool operator!=(const CellAddress &other) const { return key() != other.key(); }
+
+    // Parse a reference like "B12" or "$B$12" at the start of text without allocating.
+    // Returns the number of characters used, 0 if text does not start with a reference.
+    static size_t parse(std::string_view text, CellAddress &result);
+
+    std::string toString() const; // "B12", keeping any '$' flags
+};
+
+// A rectangle written "A1..B9" in formulas
+struct CellRange
+{
+    CellAddress first, last;
+
+    bool contains(int row, int col) const
+    {
+        return row >= first.row() && row <= last.row() && col >= first.column() && col <= last.column();
+    }
+
+    // Parse a whole range; corners are put in top-left/bottom-right order
+    static bool parse(std::string_view text, CellRange &result);
+};
+
+// Sheet names are a letter followed by letters and digits, the word forEachReference reads before '!'
+bool isSheetName(std::string_view name);
+
+// Visit every cell reference in formula text, with its position, length, the sheet
+// name before '!' (empty for the formula's own sheet) and whether it is a corner of "A1..B9"
+void forEachReference(std::string_view formula,
+                      const std::function<void(size_t pos, size_t length, const CellAddress &address,
+                                               std::string_view sheet, bool corner)> &visit);
+
+// Rewrite every cell reference in formula text through map, e.g. to shift relative references.
+// References mapped outside the grid become "#REF!".
+std::string rewriteReferences(std::string_view formula,
+                              const std::function<CellAddress(const CellAddress &address, std::string_view sheet,
+                                                              bool corner)> &map);
+
+// Column letters from a table built once ("A", ..., "XFD"); empty view if out of range
+std::string_view columnName(int col);
+
+// 0-based index of column letters (case-insensitive), -1 if they are not a valid column
+int columnIndex(std::string_view letters);
+
+#endif
@@ -1,49 +1,190 @@
 #include "file.h"
+#include "celladdress.h"
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void File::read_and_fill(const std::string &filename, Spreadsheet &sheet)
+namespace
 {
-    std::ifstream file(filename); // Uses ifstream for file reading
-    std::string line;
-    int row = 0, col = 0;
+    // A read-only mapping of a whole file, unmapped however the reader exits
+    struct MappedFile
+    {
+        void *data = MAP_FAILED;
+        size_t size = 0;
+        ~MappedFile()
+        {
+            if (data != MAP_FAILED)
+                munmap(data, size);
+        }
+    };
 
-    if (!file.is_open())
+    enum ColumnType
+    {
+        INTEGER_COLUMN,
+        DOUBLE_COLUMN,
+        TEXT_COLUMN
+    };
+
+    // Split off the next line, without its line end
+    std::string_view nextLine(std::string_view &rest)
     {
-        return; // If file couldn't open, exit
+        size_t end = rest.find('\n');
+        std::string_view line = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        return line;
     }
 
-    while (getline(file, line))
-    {                               // Read lines from file
-        std::stringstream ss(line); // Put line in a stringstream
-        std::string deger;
-        col = 0;
+    // Visit the comma separated fields of line; like getline(..., ','), a trailing comma adds no field
+    template <class Visit>
+    int forEachField(std::string_view line, Visit visit)
+    {
+        int col = 0;
+        while (!line.empty())
+        {
+            size_t comma = line.find(',');
+            visit(col++, line.substr(0, comma));
+            line.remove_prefix(comma == std::string_view::npos ? line.size() : comma + 1);
+        }
+        return col;
+    }
 
-        // Grow number of row if not enough
-        if (row >= INIT_ROW)
+    // Same result as parseWholeNumber, for fields that are a plain integer
+    bool readInteger(std::string_view field, double &number)
+    {
+        long long value;
+        const char *last = field.data() + field.size();
+        std::from_chars_result parsed = std::from_chars(field.data(), last, value);
+        if (parsed.ec != std::errc() || parsed.ptr != last || (value == 0 && field[0] == '-'))
         {
-            sheet.resizes(row + 2, INIT_COLUMN + 2); // Add new rows
+            return false; // "-0" is left to parseWholeNumber, which keeps the sign
         }
+        number = (double)value;
+        return true;
+    }
+
+    // Same result as parseWholeNumber, for fields that are a number without spaces or '+'
+    bool readDouble(std::string_view field, double &number)
+    {
+        const char *last = field.data() + field.size();
+        std::from_chars_result parsed = std::from_chars(field.data(), last, number);
+        return parsed.ec == std::errc() && parsed.ptr == last;
+    }
 
-        // Read each comma-separated element in the line
-        while (getline(ss, deger, ','))
+    // The type most non-empty fields of each column have in the first lines of text.
+    // It only picks the fast parse to try; a field that does not fit is stored as before.
+    std::vector<ColumnType> inferTypes(std::string_view text)
+    {
+        std::vector<std::array<int, 3>> counts;
+        for (int row = 0; row < SAMPLE_ROWS && !text.empty(); row++)
         {
-            // Hücreyi doldur
-            sheet.getCell(row, col).setvalue(deger);
+            forEachField(nextLine(text), [&](int col, std::string_view field) {
+                double number;
+                if ((int)counts.size() <= col)
+                    counts.resize(col + 1);
+                if (!field.empty())
+                    counts[col][readInteger(field, number) ? INTEGER_COLUMN : readDouble(field, number) ? DOUBLE_COLUMN : TEXT_COLUMN]++;
+            });
+        }
+
+        std::vector<ColumnType> types;
+        for (const std::array<int, 3> &count : counts)
+        {
+            if (count[TEXT_COLUMN] >= count[INTEGER_COLUMN] + count[DOUBLE_COLUMN])
+                types.push_back(TEXT_COLUMN);
+            else
+                types.push_back(count[DOUBLE_COLUMN] ? DOUBLE_COLUMN : INTEGER_COLUMN);
+        }
+        return types;
+    }
+}
+
+// Fill the sheet from a CSV file: a typed parse on import. Fields of numeric columns are parsed
+// once, straight into their cells' numbers, and every row is allocated at its final width.
+// Cells still keep each field's text; there is no column store or pool of repeated text.
+bool File::read_and_fill(const std::string &filename, Spreadsheet &sheet)
+{
+    truncated = false;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false; // If file couldn't open, exit
+    }
+    loadStartHeap = loadPeakHeap = heapInUse();
 
-            col++;
+    struct stat status;
+    MappedFile mapped;
+    bool found = fstat(fd, &status) == 0;
+    if (found && status.st_size > 0)
+    {
+        mapped.size = status.st_size;
+        mapped.data = mmap(nullptr, mapped.size, PROT_READ, MAP_PRIVATE, fd, 0); // Read through the page cache, not the heap
+    }
+    close(fd);
+    if (found && status.st_size == 0)
+    {
+        return true; // Empty, nothing to load
+    }
+    if (mapped.data == MAP_FAILED)
+    {
+        return false; // A directory or otherwise unreadable
+    }
+    madvise(mapped.data, mapped.size, MADV_SEQUENTIAL);
 
-            // Grow number of column if not enough
-            if (col >= INIT_COLUMN)
+    std::string_view text(static_cast<const char *>(mapped.data), mapped.size);
+    std::vector<ColumnType> types = inferTypes(text);
+    int row = 0;
+    while (!text.empty())
+    {
+        if (row >= MAX_ROWS)
+        {
+            truncated = true; // The grid is full, the rest of the file is not read
+            break;
+        }
+        std::string_view line = nextLine(text);
+        if (!line.empty())
+        {
+            sheet.reserveRow(row, (int)std::count(line.begin(), line.end(), ',') + 1);
+        }
+        int cols = forEachField(line, [&](int col, std::string_view field) {
+            if (col >= MAX_COLUMNS)
             {
-                sheet.resizes(row + 2, col + 2); // Add new columns
+                truncated = true;
+                return;
             }
-        }
+            ColumnType type = col < (int)types.size() ? types[col] : TEXT_COLUMN;
+            double number;
+            Cell &cell = sheet.getCell(row, col);
+            if ((type == INTEGER_COLUMN && readInteger(field, number)) || (type == DOUBLE_COLUMN && readDouble(field, number)))
+                cell.setvalue(field, number);
+            else
+                cell.setvalue(std::string(field));
+        });
         row++; // One more line has been processed
+        sheet.totalcols = std::max(sheet.totalcols, std::min(cols, MAX_COLUMNS));
+        if (row % HEAP_SAMPLE_ROWS == 0)
+        {
+            loadPeakHeap = std::max(loadPeakHeap, heapInUse());
+        }
     }
-
-    file.close(); // Close the file
+    sheet.totalrows = std::max(sheet.totalrows, row);
+    loadPeakHeap = std::max(loadPeakHeap, heapInUse());
+    return true;
 }
 
 void File::save_file(Spreadsheet &sheet)
+{
+    save_file(sheet.snapshot());
+}
+
+void File::save_file(const SheetSnapshot &sheet)
 {
     std::ofstream file("saved.csv"); // Save value of cells to the saved.csv
     if (!file.is_open())
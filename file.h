@@ -2,10 +2,17 @@
 #define FILE_H
 #include "sheet.h"
 
+#define HEAP_SAMPLE_ROWS 4096 // Rows read between heap samples while loading
+#define SAMPLE_ROWS 1000       // Lines read to guess the type of each column
+
 class File{
     public: 
-        void read_and_fill(const std::string& filename, Spreadsheet& sheet); // Reads and fills the grid
+        size_t loadStartHeap = 0; // Heap in use when the last read_and_fill started
+        size_t loadPeakHeap = 0;  // Highest heap use sampled while it ran
+        bool truncated = false;   // The last file had rows or columns beyond MAX_ROWS or MAX_COLUMNS, they were skipped
+        bool read_and_fill(const std::string& filename, Spreadsheet& sheet); // Reads and fills the grid with typed parse on import, false if the file cannot be read
         void save_file(Spreadsheet& sheet) ; //Saves values of cells to the csv file
+        void save_file(const SheetSnapshot& sheet); //Saves a snapshot, safe while the sheet is being edited
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "formulafunctions.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    // Value policies: which cells of a range take part and as what number
+
+    // Empty cells are skipped, text counts as the number it reads as (0 for plain text)
+    struct TextAsZero
+    {
+        static bool take(const Cell &cell, double &value)
+        {
+            if (cell.getvalue().empty())
+                return false;
+            value = cell.getnumber();
+            return true;
+        }
+    };
+
+    // Only cells holding a number take part
+    struct NumbersOnly
+    {
+        static bool take(const Cell &cell, double &value)
+        {
+            if (!cell.isnumber())
+                return false;
+            value = cell.getnumber();
+            return true;
+        }
+    };
+
+    // Operations: add() sees the values in row order, result() is 0 when there were none
+
+    struct Sum
+    {
+        double sum = 0.0;
+        void add(double value) { sum += value; }
+        double result() const { return sum; }
+    };
+
+    struct Aver
+    {
+        double sum = 0.0;
+        size_t count = 0;
+        void add(double value) { sum += value; count++; }
+        double result() const { return count ? sum / count : 0.0; }
+    };
+
+    struct Max
+    {
+        double best = 0.0;
+        bool any = false;
+        void add(double value) { best = any ? std::max(best, value) : value; any = true; }
+        double result() const { return best; }
+    };
+
+    struct Min
+    {
+        double best = 0.0;
+        bool any = false;
+        void add(double value) { best = any ? std::min(best, value) : value; any = true; }
+        double result() const { return best; }
+    };
+
+    // Sample standard deviation, two passes over the kept values for accuracy
+    struct Stddev
+    {
+        std::vector<double> values;
+        void add(double value) { values.push_back(value); }
+        double result() const
+        {
+            if (values.size() < 2)
+                return 0.0;
+            double mean = 0.0, variance = 0.0;
+            for (double value : values)
+                mean += value;
+            mean /= values.size();
+            for (double value : values)
+                variance += (value - mean) * (value - mean);
+            return std::sqrt(variance / (values.size() - 1));
+        }
+    };
+
+    struct Count
+    {
+        double count = 0.0;
+        void add(double) { count++; }
+        double result() const { return count; }
+    };
+
+    // One loop per operation and policy; cells that were never written are not visited
+    template <class Operation, class Policy>
+    double aggregate(const Spreadsheet &sheet, int firstRow, int firstCol, int lastRow, int lastCol)
+    {
+        Operation operation;
+        double value;
+        lastRow = std::min(lastRow, sheet.totalrows - 1);
+        for (int i = firstRow; i <= lastRow; i++)
+        {
+            const std::vector<Cell> &row = sheet.getRow(i);
+            int last = std::min(lastCol, (int)row.size() - 1);
+            for (int j = firstCol; j <= last; j++)
+            {
+                if (Policy::take(row[j], value))
+                    operation.add(value);
+            }
+        }
+        return operation.result();
+    }
+
+    // A new aggregate needs an operation above and one line here
+    const FunctionInfo functions[] = {
+        {"SUM", FormulaFunction::Sum, aggregate<Sum, TextAsZero>},
+        {"AVER", FormulaFunction::Aver, aggregate<Aver, TextAsZero>},
+        {"MAX", FormulaFunction::Max, aggregate<Max, TextAsZero>},
+        {"MIN", FormulaFunction::Min, aggregate<Min, TextAsZero>},
+        {"STDDEV", FormulaFunction::Stddev, aggregate<Stddev, TextAsZero>},
+        {"COUNT", FormulaFunction::Count, aggregate<Count, NumbersOnly>},
+        {"VLOOKUP", FormulaFunction::Vlookup, nullptr},
+        {"MATCH", FormulaFunction::Match, nullptr},
+        {"COUNTIF", FormulaFunction::Countif, nullptr},
+        {"SUMIF", FormulaFunction::Sumif, nullptr},
+    };
+}
+
+const FunctionInfo *findFunction(std::string_view name)
+{
+    if (name.empty() || name.size() > MAX_FUNCTION_NAME)
+    {
+        return nullptr;
+    }
+    char upper[MAX_FUNCTION_NAME];
+    bool lower = islower((unsigned char)name[0]);
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        char ch = name[i];
+        if (!isalpha((unsigned char)ch) || (islower((unsigned char)ch) != 0) != lower)
+        {
+            return nullptr; // "Sum" is not a function name, only "SUM" and "sum" are
+        }
+        upper[i] = (char)toupper((unsigned char)ch);
+    }
+    std::string_view key(upper, name.size());
+    for (const FunctionInfo &function : functions)
+    {
+        if (key == function.name)
+        {
+            return &function;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,46 @@
+#ifndef FORMULAFUNCTIONS_H
+#define FORMULAFUNCTIONS_H
+#include <string_view>
+#include "sheet.h"
+
+#define MAX_FUNCTION_NAME 7 // "VLOOKUP", "COUNTIF"
+
+// Lookups match keys by the lookupKey() rules: numbers by value, text without regard to case,
+// and empty cells never match. Like every formula they produce a number; a text cell found by
+// VLOOKUP reads as zero, as text does anywhere in a formula.
+//   VLOOKUP(key, range, column[, approximate])  exact match unless approximate is TRUE or
+//                                               non-zero, which wants the first column ascending
+//   MATCH(key, range[, type])                   0 (the default) exact, 1 the last value not above
+//                                               key in ascending data, -1 the last not below it
+//                                               in descending data; 0 if nothing is found
+//   COUNTIF(range, criterion)                   criterion is a key or a comparison such as
+//   SUMIF(range, criterion[, sumRange])         ">15", "<=x", "<>0" or "=apple"
+enum class FormulaFunction
+{
+    Sum,
+    Aver,
+    Max,
+    Min,
+    Stddev,
+    Count,
+    Vlookup,
+    Match,
+    Countif,
+    Sumif
+};
+
+// Aggregates the cells of rows firstRow..lastRow, columns firstCol..lastCol
+typedef double (*RangeKernel)(const Spreadsheet &sheet, int firstRow, int firstCol, int lastRow, int lastCol);
+
+struct FunctionInfo
+{
+    const char *name;
+    FormulaFunction id;
+    RangeKernel kernel; // Range functions only; lookups go through formulaparser::computeLookupFunction
+};
+
+// The function called name, written in all upper or all lower case; nullptr if there is none.
+// Formulas resolve each call once through this table and then only use the kernel.
+const FunctionInfo *findFunction(std::string_view name);
+
+#endif
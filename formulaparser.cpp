@@ -1,39 +1,33 @@
 #include "formulaparser.h"
+#include "numberformat.h"
+#include "workbook.h"
+#include "lookupindex.h"
+#include "formulafunctions.h"
 #include <cmath>
 #include <sstream>
 #include <algorithm>
-#include <numeric>
-#define ASCII_OF_A 65
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#define READER_BUCKET_ROWS 64  // Rows per bucket of the range reader index in recalculate()
+#define MAX_READER_BUCKETS 256 // Buckets a range may be filed under before it is checked for every cell
 
 // Convert column name (e.g., "A") to a 0-based index
 int formulaparser::columnNameToIndex(const std::string &columnName)
 {
-    int colIndex = 0;
-    for (char ch : columnName)
-    {
-        colIndex = colIndex * 26 + (ch - ASCII_OF_A + 1); // Convert 'A' to 1, 'B' to 2, etc.
-    }
-    return colIndex - 1; // Convert to 0-based index
+    return columnIndex(columnName);
 }
 
-// Parse a cell identifier like "A1" into row and column indices
+// Parse a cell identifier like "A1" or "$A$1" into row and column indices; {-1, -1} if it is not one
 std::pair<int, int> formulaparser::parseCellReference(const std::string &cellRef)
 {
-    size_t pos = 0;
-
-    // Extract column part (e.g., "A")
-    while (pos < cellRef.size() && isalpha(cellRef[pos]))
+    CellAddress address;
+    if (CellAddress::parse(cellRef, address) == 0)
     {
-        pos++;
+        return {-1, -1};
     }
-
-    std::string colPart = cellRef.substr(0, pos);
-    std::string rowPart = cellRef.substr(pos);
-
-    int col = columnNameToIndex(colPart);   // Convert column to 0-based index
-    int row = safeStringToInt(rowPart) - 1; // Convert row to 0-based index
-
-    return {row, col};
+    return {address.row(), address.column()};
 }
 
 // Ensure the spreadsheet has enough space to accommodate a referenced cell
@@ -50,26 +44,14 @@ void formulaparser::ensureCellBounds(int row, int col, Spreadsheet &sheet)
 // Convert string to double safely; return 0.0 if conversion fails
 double formulaparser::safeStringToDouble(const std::string &str)
 {
-    try
-    {
-        return std::stod(str); // std::stod handles double conversion
-    }
-    catch (...)
-    {
-        return 0.0;
-    }
+    double result;
+    return parseNumber(str, result) ? result : 0.0;
 }
 
 int formulaparser::safeStringToInt(const std::string &str)
 {
-    try
-    {
-        return std::stoi(str); // std::stod handles double conversion
-    }
-    catch (...)
-    {
-        return 0.0;
-    }
+    int result;
+    return parseInteger(str, result) ? result : 0;
 }
 
 const char* formulaparser:: findChar(const char* str, char ch) {
@@ -83,258 +65,584 @@ const char* formulaparser:: findChar(const char* str, char ch) {
 }
 
 
-// Parse range functions like MAX, MIN, SUM, etc., and return the computed result
-double formulaparser::computeRangeFunction(const std::string &function, const std::string &range, Spreadsheet &sheet)
+// Strip a "Sheet2!" prefix from a reference and return the sheet it names.
+// Without a prefix the formula's own sheet is returned; nullptr for an unknown sheet.
+Spreadsheet *formulaparser::referencedSheet(std::string_view &reference, Spreadsheet &sheet)
 {
-    // Check if the range has a valid format with a column letter
-    bool validFormat = false;
-    for (char ch : range)
+    size_t bang = reference.find('!');
+    if (bang == std::string_view::npos)
     {
-        if (isalpha(ch))
-        {
-            validFormat = true;
-            break;
-        }
+        return &sheet;
     }
+    Spreadsheet *target = workbook ? workbook->findSheetByName(reference.substr(0, bang)) : nullptr;
+    reference.remove_prefix(bang + 1);
+    return target;
+}
 
-    // If range is invalid or doesn't contain a column letter, return 0
-    if (!validFormat)
-    {
-        return 0.0;
-    }
+// Parse range functions like MAX, MIN, SUM, etc., and return the computed result
+double formulaparser::computeRangeFunction(const FunctionInfo &function, const std::string &range, Spreadsheet &sheet)
+{
+    std::string_view rangeText = range;
+    Spreadsheet *target = referencedSheet(rangeText, sheet);
 
-    // Check for valid range separator
-    size_t separator = range.find("..");
-    if (separator == std::string::npos)
+    CellRange cells;
+    if (!target || !CellRange::parse(rangeText, cells))
     {
         return 0.0;
     }
 
-    std::string startCell = range.substr(0, separator);
-    std::string endCell = range.substr(separator + 2);
+    int startRow = cells.first.row(), startCol = cells.first.column();
+    int endRow = cells.last.row(), endCol = cells.last.column();
 
-    // Validate cell references have column letters
-    if (startCell.empty() || endCell.empty() || 
-        !isalpha(startCell[0]) || !isalpha(endCell[0]))
+    // Ensure bounds; other sheets are only read, cells outside them count as empty
+    if (target == &sheet)
     {
-        return 0.0;
+        try
+        {
+            ensureCellBounds(startRow, startCol, sheet);
+            ensureCellBounds(endRow, endCol, sheet);
+        }
+        catch (...)
+        {
+            return 0.0;
+        }
     }
 
-    auto [startRow, startCol] = parseCellReference(startCell);
-    auto [endRow, endCol] = parseCellReference(endCell);
+    return function.kernel(*target, startRow, startCol, endRow, endCol); // Reads never copy shared blocks
+}
 
-    // Additional bounds checking
-    if (startRow < 0 || endRow < 0 || startCol < 0 || endCol < 0)
+double formulaparser::computeLookupFunction(FormulaFunction function, const std::string &arguments, Spreadsheet &sheet)
+{
+    std::vector<std::string_view> args;
+    std::string_view rest = arguments;
+    for (size_t comma = rest.find(','); ; comma = rest.find(','))
     {
-        return 0.0;
+        std::string_view arg = rest.substr(0, comma);
+        while (!arg.empty() && arg.front() == ' ')
+            arg.remove_prefix(1);
+        while (!arg.empty() && arg.back() == ' ')
+            arg.remove_suffix(1);
+        args.push_back(arg);
+        if (comma == std::string_view::npos)
+            break;
+        rest.remove_prefix(comma + 1);
     }
 
-    // Ensure bounds
-    try 
+    // A range argument, with the sheet it is on
+    auto rangeArg = [&](size_t i, const Spreadsheet *&target, CellRange &range) {
+        if (i >= args.size())
+            return false;
+        std::string_view text = args[i];
+        target = referencedSheet(text, sheet);
+        return target && CellRange::parse(text, range);
+    };
+
+    // The text of an argument: inside quotes, the value of a referenced cell or the literal
+    auto textArg = [&](size_t i) {
+        if (i >= args.size())
+            return std::string();
+        std::string_view text = args[i];
+        if (text.size() >= 2 && text.front() == '"' && text.back() == '"')
+            return std::string(text.substr(1, text.size() - 2));
+        std::string_view reference = text;
+        const Spreadsheet *target = referencedSheet(reference, sheet);
+        CellAddress address;
+        bool isReference = !reference.empty() && (isalpha((unsigned char)reference[0]) || reference[0] == '$') &&
+                           CellAddress::parse(reference, address) == reference.size();
+        if (isReference || reference.size() != text.size())
+        {
+            const Cell *cell = target && isReference ? target->findCell(address.row(), address.column()) : nullptr;
+            return cell ? cell->getvalue() : std::string();
+        }
+        return std::string(text);
+    };
+
+    // Position of key among count cells read through cellAt. Type 0 wants an equal key; type 1
+    // the last cell not above key in ascending cells, type -1 the last not below it in descending ones.
+    auto search = [](const Criterion &key, int count, auto cellAt, int type) {
+        int found = -1;
+        for (int k = 0; k < count; k++)
+        {
+            const Cell *cell = cellAt(k);
+            int order;
+            if (!cell || !key.compare(*cell, order))
+                continue;
+            if (type == 0 ? order == 0 : order * type > 0)
+            {
+                if (type == 0)
+                    return k;
+                break; // Past the key in sorted order
+            }
+            found = type == 0 ? found : k;
+        }
+        return found;
+    };
+
+    const Spreadsheet *target;
+    CellRange range;
+    if (function == FormulaFunction::Vlookup)
     {
-        ensureCellBounds(startRow, startCol, sheet);
-        ensureCellBounds(endRow, endCol, sheet);
+        Criterion key("=" + textArg(0)); // Equal to the text, even if it starts with '<' or '>'
+        int column = args.size() > 2 ? safeStringToInt(std::string(args[2])) : 0;
+        std::string flag = textArg(3);
+        for (char &ch : flag)
+            ch = (char)toupper((unsigned char)ch);
+        bool approximate = flag == "TRUE" || (flag != "FALSE" && safeStringToDouble(flag) != 0);
+        if (key.key.empty() || !rangeArg(1, target, range) || column < 1 ||
+            column > range.last.column() - range.first.column() + 1)
+            return 0.0;
+        int row = -1;
+        if (approximate)
+        {
+            int count = std::min(range.last.row(), target->totalrows - 1) - range.first.row() + 1;
+            int found = search(key, count, [&](int k) { return target->findCell(range.first.row() + k, range.first.column()); }, 1);
+            row = found < 0 ? -1 : range.first.row() + found;
+        }
+        else
+            row = target->columnIndex(range.first.column())->first(key.key, range.first.row(), range.last.row());
+        const Cell *cell = row < 0 ? nullptr : target->findCell(row, range.first.column() + column - 1);
+        return cell ? cell->getnumber() : 0.0;
     }
-    catch (...)
+    if (function == FormulaFunction::Match)
     {
+        Criterion key("=" + textArg(0));
+        int type = args.size() > 2 ? safeStringToInt(std::string(args[2])) : 0;
+        type = type > 0 ? 1 : type < 0 ? -1 : 0;
+        if (key.key.empty() || !rangeArg(1, target, range))
+            return 0.0;
+        if (range.first.row() == range.last.row() && range.first.column() != range.last.column())
+        {
+            int count = std::min(range.last.column(), target->totalcols - 1) - range.first.column() + 1;
+            int found = search(key, count, [&](int k) { return target->findCell(range.first.row(), range.first.column() + k); }, type);
+            return found + 1; // A single row is searched directly; 0 if nothing matched
+        }
+        if (type != 0)
+        {
+            int count = std::min(range.last.row(), target->totalrows - 1) - range.first.row() + 1;
+            return search(key, count, [&](int k) { return target->findCell(range.first.row() + k, range.first.column()); }, type) + 1;
+        }
+        int row = target->columnIndex(range.first.column())->first(key.key, range.first.row(), range.last.row());
+        return row < 0 ? 0.0 : row - range.first.row() + 1;
+    }
+
+    // COUNTIF and SUMIF: an equal key is looked up in the column indexes, other criteria
+    // are checked against every written cell of the range
+    Criterion criterion(textArg(1));
+    if (criterion.key.empty() || !rangeArg(0, target, range))
+        return 0.0;
+    const Spreadsheet *sumSheet = target;
+    CellRange sumRange = range;
+    if (function == FormulaFunction::Sumif && args.size() > 2 && !rangeArg(2, sumSheet, sumRange))
         return 0.0;
+    double total = 0.0;
+    auto take = [&](int row, int col) {
+        if (function == FormulaFunction::Countif)
+        {
+            total += 1;
+            return;
+        }
+        const Cell *cell = sumSheet->findCell(sumRange.first.row() + (row - range.first.row()),
+                                              sumRange.first.column() + (col - range.first.column()));
+        if (cell)
+            total += cell->getnumber();
+    };
+    int lastRow = std::min(range.last.row(), target->totalrows - 1);
+    int lastColumn = std::min(range.last.column(), target->totalcols - 1); // No index for columns never written
+    for (int j = range.first.column(); j <= lastColumn; j++)
+    {
+        if (criterion.comparison == Criterion::EQUAL)
+        {
+            auto [begin, end] = target->columnIndex(j)->find(criterion.key, range.first.row(), range.last.row());
+            if (function == FormulaFunction::Countif)
+                total += end - begin;
+            else
+                for (auto row = begin; row != end; ++row)
+                    take(*row, j);
+            continue;
+        }
+        for (int i = range.first.row(); i <= lastRow; i++)
+        {
+            const Cell *cell = target->findCell(i, j);
+            if (cell && criterion.matches(*cell))
+                take(i, j);
+        }
     }
+    return total;
+}
 
-    // Gather non-empty values in the range
-    std::vector<double> values;
-    for (int i = startRow; i <= endRow; i++)
+// Value of one operand: a cell reference (A1, $A$1, Sheet2!A1) or a number
+double formulaparser::operandValue(const std::string &operand, Spreadsheet &sheet)
+{
+    std::string_view reference = operand;
+    Spreadsheet *target = referencedSheet(reference, sheet);
+    if (!target)
+    {
+        return 0.0; // Unknown sheet
+    }
+    if (!reference.empty() && (isalpha(reference[0]) || reference[0] == '$'))
     {
-        for (int j = startCol; j <= endCol; j++)
+        CellAddress address;
+        if (CellAddress::parse(reference, address) == 0)
         {
-            std::string cellValue = sheet.getCell(i, j).getvalue();
-            // Only add non-empty values
-            if (!cellValue.empty())
-            {
-                values.push_back(safeStringToDouble(cellValue));
-            }
+            return 0.0; // Not a valid reference
+        }
+        if (target == &sheet)
+        {
+            ensureCellBounds(address.row(), address.column(), sheet);
         }
+        const Cell *cell = static_cast<const Spreadsheet &>(*target).findCell(address.row(), address.column());
+        return cell ? cell->getnumber() : 0.0;
     }
+    return safeStringToDouble(operand); // Numeric value
+}
 
-    // Return 0 if no valid values
-    if (values.empty())
+// True if sign belongs to the exponent of the number being read, as in "1e-05"
+static bool isExponentSign(const std::string &operand, char sign)
+{
+    if ((sign != '-' && sign != '+') || operand.size() < 2 || (operand.back() != 'e' && operand.back() != 'E'))
     {
-        return 0.0;
+        return false;
+    }
+    for (size_t i = 0; i + 1 < operand.size(); i++)
+    {
+        if (!isdigit((unsigned char)operand[i]) && operand[i] != '.')
+        {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Perform the specified function
-    if (function == "SUM" || function == "sum")
+// Parse the spreadsheet grid for formulas
+void formulaparser::parseGrid(Spreadsheet &sheet)
+{
+    const Spreadsheet &view = sheet;
+    for (int i = 0; i < sheet.totalrows; i++)
     {
-        return std::accumulate(values.begin(), values.end(), 0.0);
+        int allocated = std::min(sheet.totalcols, (int)view.getRow(i).size()); // Cells never written hold no formula
+        for (int j = 0; j < allocated; j++)
+        {
+            evaluateCell(i, j, sheet);
+        }
     }
-    else if (function == "AVER" || function == "aver")
+}
+
+// Evaluate the formula of one cell, if it has one
+void formulaparser::evaluateCell(int row, int col, Spreadsheet &sheet)
+{
+    const Spreadsheet &view = sheet; // Reads must not copy blocks shared with a snapshot
+    std::shared_ptr<const Formula> formula = view.getCell(row, col).getformula(); // Outlives writes to the cell
+    if (!formula || formula->text[0] != '=')
     {
-        return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        return;
     }
-    else if (function == "STDDEV" || function == "stddev")
+
+    std::string resolvedExpression = resolveFunctions(*formula, sheet);
+
+    std::vector<double> elements;
+    std::vector<char> operators;
+    std::string operand;
+    bool negative = false; // A '-' sign before the operand being read
+
+    // Parse the resolved expression after replacing function calls
+    for (size_t k = 0; k < resolvedExpression.size(); ++k)
     {
-        if (values.size() < 2)
-            return 0.0;
-        double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
-        double variance = 0.0;
-        for (double val : values)
+        char currentChar = resolvedExpression[k];
+
+        if (findChar("+-/*", currentChar) && !isExponentSign(operand, currentChar))
         {
-            variance += (val - mean) * (val - mean);
+            // Process the accumulated operand before the operator
+            if (!operand.empty())
+            {
+                double value = operandValue(operand, sheet);
+                elements.push_back(negative ? -value : value);
+                operand.clear();
+                negative = false;
+            }
+            else if (currentChar == '-' || currentChar == '+')
+            {
+                // A sign, as in "2*-3" after a function returned a negative number
+                negative = negative != (currentChar == '-');
+                continue;
+            }
+            else
+            {
+                elements.push_back(0.0); // "*2": a missing operand reads as zero
+            }
+            operators.push_back(currentChar);
+        }
+        else
+        {
+            // Accumulate the operand
+            operand += currentChar;
         }
-        variance /= values.size() - 1;
-        return std::sqrt(variance);
     }
-    else if (function == "MAX" || function == "max")
+
+    // Process the last operand; a trailing operator gets zero
+    if (!operand.empty())
     {
-        return *std::max_element(values.begin(), values.end());
+        double value = operandValue(operand, sheet);
+        elements.push_back(negative ? -value : value);
     }
-    else if (function == "MIN" || function == "min")
+    else if (!operators.empty())
     {
-        return *std::min_element(values.begin(), values.end());
+        elements.push_back(0.0);
     }
 
-    return 0.0;
+    // Perform the calculations
+    if (!elements.empty())
+    {
+        if (calculate(elements, operators, sheet.getComputedCell(row, col)))
+        {
+            sheet.columnChanged(col);
+        }
+    }
 }
 
-// Parse the spreadsheet grid for formulas
-void formulaparser::parseGrid(Spreadsheet &sheet)
+// Cells and ranges of its own sheet that a formula reads ("A1" becomes the range A1..A1)
+std::vector<CellRange> formulaparser::collectReferences(const std::string &expression)
 {
-    for (int i = 0; i < sheet.totalrows; i++)
-    {
-        for (int j = 0; j < sheet.totalcols; j++)
+    std::vector<CellRange> ranges;
+    bool open = false; // The last range still waits for its second corner
+    forEachReference(expression, [&](size_t, size_t, const CellAddress &address, std::string_view sheet, bool corner) {
+        if (open)
         {
-            std::string expression = sheet.getCell(i, j).getexpression();
-            if (!expression.empty() && expression[0] == '=')
+            open = false;
+            if (sheet.empty() && corner)
             {
-                std::string resolvedExpression = resolveFunctions(expression.substr(1), sheet);
+                CellRange &range = ranges.back(); // Second corner of "A1..B9"
+                CellAddress first = range.first;
+                range.first = CellAddress(std::min(first.row(), address.row()), std::min(first.column(), address.column()));
+                range.last = CellAddress(std::max(first.row(), address.row()), std::max(first.column(), address.column()));
+                return;
+            }
+        }
+        if (!sheet.empty())
+        {
+            return; // Other sheets are tracked by the workbook
+        }
+        ranges.push_back(CellRange{address, address});
+        open = corner;
+    });
+    return ranges;
+}
 
-                std::vector<double> elements;
-                std::vector<char> operators;
-                std::string operand;
-                bool parsingNumber = false;
+// Recalculate only the formulas that read the changed cells, directly or through
+// other formulas, each once and after the formulas it reads
+void formulaparser::recalculate(Spreadsheet &sheet, const std::vector<CellAddress> &changed)
+{
+    const Spreadsheet &view = sheet;
+    std::vector<CellAddress> formulas;
+    std::unordered_map<std::uint64_t, int> formulaAt;
+    std::unordered_map<std::uint64_t, std::vector<int>> cellReaders; // Formulas reading a single cell
+
+    // Each distinct range read by formulas is one node, shared by all of its readers, so a
+    // formula inside a range read by many formulas is linked to the range once rather than
+    // to every reader. A formula reading a range it lies in gets a node of its own.
+    std::vector<CellRange> ranges;
+    std::vector<int> rangeOwner;                // The reader inside the range, else -1
+    std::vector<std::vector<int>> rangeReaders; // Formulas reading each range
+    std::map<std::tuple<std::uint64_t, std::uint64_t, int>, int> rangeIds;
+    // Ranges are filed under every bucket of READER_BUCKET_ROWS rows of one column they
+    // cover; ranges spanning more than MAX_READER_BUCKETS are checked for every cell
+    std::unordered_map<std::uint64_t, std::vector<int>> rangeBuckets;
+    std::vector<int> wideRanges;
+    auto bucketKey = [](int row, int col) {
+        return ((std::uint64_t)col << 32) | (std::uint64_t)(row / READER_BUCKET_ROWS);
+    };
 
-                // Parse the resolved expression after replacing function calls
-                for (size_t k = 0; k < resolvedExpression.size(); ++k)
+    for (int i = 0; i < sheet.totalrows; i++)
+    {
+        int allocated = std::min(sheet.totalcols, (int)view.getRow(i).size());
+        for (int j = 0; j < allocated; j++)
+        {
+            const Cell *cell = view.findCell(i, j);
+            if (!cell || cell->getexpression().empty() || cell->getexpression()[0] != '=')
+                continue;
+            int index = (int)formulas.size();
+            formulas.push_back(CellAddress(i, j));
+            formulaAt[formulas.back().key()] = index;
+            for (const CellRange &range : collectReferences(cell->getexpression()))
+            {
+                if (range.first == range.last)
                 {
-                    char currentChar = resolvedExpression[k];
-
-                    if (findChar("+-/*", currentChar))
-                    {
-                        // Process the accumulated operand before the operator
-                        if (!operand.empty())
-                        {
-                            if (isalpha(operand[0]))
-                            {
-                                // Handle cell reference
-                                auto [row, col] = parseCellReference(operand);
-                                ensureCellBounds(row, col, sheet);
-                                double cellValue = safeStringToDouble(sheet.getCell(row, col).getvalue());
-                                elements.push_back(cellValue);
-                            }
-                            else
-                            {
-                                // Handle numeric value
-                                elements.push_back(safeStringToDouble(operand));
-                            }
-                            operand.clear();
-                        }
-                        operators.push_back(currentChar);
-                        parsingNumber = false;
-                    }
-                    else
-                    {
-                        // Accumulate the operand
-                        operand += currentChar;
-                    }
+                    cellReaders[range.first.key()].push_back(index);
+                    continue;
                 }
-
-                // Process the last operand
-                if (!operand.empty())
+                int owner = range.contains(i, j) ? index : -1;
+                auto [found, added] = rangeIds.insert({{range.first.key(), range.last.key(), owner}, (int)ranges.size()});
+                int id = found->second;
+                if (added)
                 {
-                    if (isalpha(operand[0]))
-                    {
-                        auto [row, col] = parseCellReference(operand);
-                        ensureCellBounds(row, col, sheet);
-                        double cellValue = safeStringToDouble(sheet.getCell(row, col).getvalue());
-                        elements.push_back(cellValue);
-                    }
+                    ranges.push_back(range);
+                    rangeOwner.push_back(owner);
+                    rangeReaders.emplace_back();
+                    int firstBucket = range.first.row() / READER_BUCKET_ROWS, lastBucket = range.last.row() / READER_BUCKET_ROWS;
+                    long long buckets = (long long)(lastBucket - firstBucket + 1) * (range.last.column() - range.first.column() + 1);
+                    if (buckets > MAX_READER_BUCKETS)
+                        wideRanges.push_back(id);
                     else
                     {
-                        elements.push_back(safeStringToDouble(operand));
+                        for (int col = range.first.column(); col <= range.last.column(); col++)
+                            for (int bucket = firstBucket; bucket <= lastBucket; bucket++)
+                                rangeBuckets[bucketKey(bucket * READER_BUCKET_ROWS, col)].push_back(id);
                     }
                 }
-
-                // Perform the calculations
-                if (!elements.empty())
-                {
-                    calculate(elements, operators, sheet.getCell(i, j));
-                }
+                if (rangeReaders[id].empty() || rangeReaders[id].back() != index)
+                    rangeReaders[id].push_back(index);
             }
         }
     }
-}
 
-// Resolves functions (SUM, MAX, MIN, etc.) and evaluates them in the expression
-std::string formulaparser::resolveFunctions(const std::string &expression, Spreadsheet &sheet)
-{
-    std::string result = expression;
-    size_t pos = 0;
+    auto forEachRange = [&](const CellAddress &address, const std::function<void(int)> &visit) {
+        auto bucket = rangeBuckets.find(bucketKey(address.row(), address.column()));
+        if (bucket != rangeBuckets.end())
+        {
+            for (int id : bucket->second)
+            {
+                if (ranges[id].contains(address.row(), address.column()))
+                    visit(id);
+            }
+        }
+        for (int id : wideRanges)
+        {
+            if (ranges[id].contains(address.row(), address.column()))
+                visit(id);
+        }
+    };
 
-    while (pos < result.length())
+    // Mark every formula reachable from the changed cells
+    std::vector<bool> affected(formulas.size()), rangeAffected(ranges.size());
+    std::vector<CellAddress> work;
+    auto mark = [&](int index) {
+        if (!affected[index])
+        {
+            affected[index] = true;
+            work.push_back(formulas[index]);
+        }
+    };
+    auto markReaders = [&](const CellAddress &address) {
+        auto found = cellReaders.find(address.key());
+        if (found != cellReaders.end())
+        {
+            for (int reader : found->second)
+                mark(reader);
+        }
+        forEachRange(address, [&](int id) {
+            if (rangeAffected[id])
+                return; // Its readers are marked already
+            rangeAffected[id] = true;
+            for (int reader : rangeReaders[id])
+                mark(reader);
+        });
+    };
+    for (const CellAddress &address : changed)
     {
-        size_t funcStart = result.find_first_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz", pos);
-        if (funcStart == std::string::npos)
-            break;
+        auto found = formulaAt.find(address.key());
+        if (found != formulaAt.end())
+            mark(found->second); // The formula itself was edited
+        markReaders(address);
+    }
+    while (!work.empty())
+    {
+        CellAddress address = work.back();
+        work.pop_back();
+        markReaders(address);
+    }
 
-        // Check if this is actually a function and not just a cell reference
-        size_t funcEnd = result.find('(', funcStart);
-        if (funcEnd == std::string::npos)
+    // Order the affected formulas so each runs after the affected formulas it reads.
+    // Nodes are the formulas followed by the ranges; a range is ready once every
+    // affected formula inside it ran.
+    int rangeNode = (int)formulas.size();
+    std::vector<int> waiting(formulas.size() + ranges.size(), 0);
+    std::vector<std::vector<int>> next(waiting.size());
+    auto link = [&](int from, int to) {
+        next[from].push_back(to);
+        waiting[to]++;
+    };
+    for (size_t i = 0; i < formulas.size(); i++)
+    {
+        if (!affected[i])
+            continue;
+        auto found = cellReaders.find(formulas[i].key());
+        if (found != cellReaders.end())
         {
-            pos = funcStart + 1;
+            for (int reader : found->second)
+            {
+                if (reader != (int)i)
+                    link((int)i, reader);
+            }
+        }
+        forEachRange(formulas[i], [&](int id) {
+            if (rangeOwner[id] != (int)i)
+                link((int)i, rangeNode + id);
+        });
+    }
+    for (size_t id = 0; id < ranges.size(); id++)
+    {
+        if (!rangeAffected[id])
             continue;
+        for (int reader : rangeReaders[id])
+            link(rangeNode + (int)id, reader);
+    }
+    std::vector<int> ready;
+    for (size_t node = 0; node < waiting.size(); node++)
+    {
+        bool live = node < formulas.size() ? affected[node] : rangeAffected[node - rangeNode];
+        if (live && waiting[node] == 0)
+            ready.push_back((int)node);
+    }
+    std::vector<int> order;
+    std::vector<bool> ordered(formulas.size());
+    for (size_t k = 0; k < ready.size(); k++)
+    {
+        int node = ready[k];
+        if (node < rangeNode)
+        {
+            order.push_back(node);
+            ordered[node] = true;
         }
-
-        std::string function = result.substr(funcStart, funcEnd - funcStart);
-
-        // Find matching closing parenthesis
-        size_t rangeEnd = funcEnd;
-        int parenCount = 1;
-        while (parenCount > 0 && ++rangeEnd < result.length())
+        for (int following : next[node])
         {
-            if (result[rangeEnd] == '(')
-                parenCount++;
-            if (result[rangeEnd] == ')')
-                parenCount--;
+            if (--waiting[following] == 0)
+                ready.push_back(following);
         }
+    }
+    for (size_t i = 0; i < formulas.size(); i++)
+    {
+        if (affected[i] && !ordered[i])
+            order.push_back((int)i); // Part of a cycle: fall back to grid order
+    }
 
-        if (parenCount > 0)
-            break; // Mismatched parentheses
-
-        std::string range = result.substr(funcEnd + 1, rangeEnd - funcEnd - 1);
-
-        // Only process if it's actually a range function
-        if (function == "SUM" || function == "sum" || function == "MAX" || function == "max" || function == "MIN" ||
-             function == "min" || function == "AVER" || function == "aver" || function == "STDDEV"|| function == "stddev")
-        {
-            // Compute the value of the function
-            double computedValue = computeRangeFunction(function, range, sheet);
+    for (int index : order)
+    {
+        evaluateCell(formulas[index].row(), formulas[index].column(), sheet);
+    }
+}
 
-            // Replace the function call with its computed value
-            std::ostringstream oss;
-            oss << computedValue;
-            result.replace(funcStart, rangeEnd - funcStart + 1, oss.str());
+// Evaluates the calls (SUM, MAX, MIN, etc.) found when the formula was set and splices in their values
+std::string formulaparser::resolveFunctions(const Formula &formula, Spreadsheet &sheet)
+{
+    const std::string &expression = formula.text;
+    std::string result;
+    size_t pos = 1; // Everything from the '=' up to pos has been copied to result
 
-            pos = funcStart + oss.str().length();
-        }
-        else
-        {
-            pos = funcStart + 1; // Skip this occurrence and continue searching
-        }
+    for (const Formula::Call &call : formula.calls)
+    {
+        // Replace the function call with its computed value
+        std::string arguments = expression.substr(call.open + 1, call.close - call.open - 1);
+        double computedValue = call.function->kernel ? computeRangeFunction(*call.function, arguments, sheet)
+                                                     : computeLookupFunction(call.function->id, arguments, sheet);
+        result.append(expression, pos, call.nameStart - pos);
+        result += formatNumber(computedValue);
+        pos = call.close + 1;
     }
 
+    result.append(expression, pos, std::string::npos);
     return result;
 }
 // Perform arithmetic calculations on the current cell
-void formulaparser::calculate(std::vector<double> elements, std::vector<char> operators, Cell &currentcell)
+bool formulaparser::calculate(std::vector<double> elements, std::vector<char> operators, Cell &currentcell)
 {
     for (size_t i = 0; i < operators.size();)
     {
@@ -358,7 +666,5 @@ void formulaparser::calculate(std::vector<double> elements, std::vector<char> op
     }
 
     // Set the final result to the current cell
-    std::ostringstream oss;
-    oss << result;
-    currentcell.setvalue(oss.str());
+    return currentcell.setnumber(result);
 }
\ No newline at end of file
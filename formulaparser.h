@@ -3,18 +3,33 @@
 #include <string>
 #include <vector>
 #include "sheet.h"
+#include "celladdress.h"
+#include "formulafunctions.h"
+
+class Workbook;
+
 class formulaparser
 {
+private:
+    Workbook *workbook; // Resolves "Sheet2!A1" references, may be null
+
 public:
+    formulaparser(Workbook *book = nullptr) : workbook(book) {}
     void parseGrid(Spreadsheet &sheet);
-    void calculate(std::vector<double> elemans, std::vector<char> signs, Cell &currentcell);
+    void evaluateCell(int row, int col, Spreadsheet &sheet);
+    void recalculate(Spreadsheet &sheet, const std::vector<CellAddress> &changed);
+    std::vector<CellRange> collectReferences(const std::string &expression);
+    bool calculate(std::vector<double> elemans, std::vector<char> signs, Cell &currentcell); // true if the cell changed
     int columnNameToIndex(const std::string &columnName);
     double safeStringToDouble(const std::string &str);
     int safeStringToInt(const std::string &str);
     const char* findChar(const char* str, char ch);
-    double computeRangeFunction(const std::string &function, const std::string &range, Spreadsheet &sheet);
-    std::string resolveFunctions(const std::string &expression, Spreadsheet &sheet);
+    double computeRangeFunction(const FunctionInfo &function, const std::string &range, Spreadsheet &sheet);
+    double computeLookupFunction(FormulaFunction function, const std::string &arguments, Spreadsheet &sheet);
+    std::string resolveFunctions(const Formula &formula, Spreadsheet &sheet); // The text after '=', calls replaced by values
     void ensureCellBounds(int row, int col, Spreadsheet &sheet);
     std::pair<int, int> parseCellReference(const std::string &cellRef);
+    double operandValue(const std::string &operand, Spreadsheet &sheet);
+    Spreadsheet *referencedSheet(std::string_view &reference, Spreadsheet &sheet);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "lookupindex.h"
+#include "memoryusage.h"
+#include "numberformat.h"
+#include "sheet.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+std::string lookupKey(const Cell &cell)
+{
+    if (cell.getvalue().empty())
+    {
+        return "";
+    }
+    if (cell.isnumber())
+    {
+        return "#" + formatNumber(cell.getnumber() + 0.0); // + 0.0 turns -0 into 0
+    }
+    return lookupKey(std::string_view(cell.getvalue()));
+}
+
+std::string lookupKey(std::string_view text)
+{
+    double number;
+    if (text.empty())
+    {
+        return "";
+    }
+    if (parseWholeNumber(text, number))
+    {
+        return "#" + formatNumber(number + 0.0);
+    }
+    std::string key = "'";
+    for (char ch : text)
+    {
+        key += (char)toupper((unsigned char)ch);
+    }
+    return key;
+}
+
+Criterion::Criterion(std::string_view text)
+{
+    static const struct
+    {
+        const char *prefix;
+        Comparison comparison;
+    } prefixes[] = {{"<>", NOT_EQUAL}, {"<=", LESS_EQUAL}, {">=", GREATER_EQUAL},
+                    {"<", LESS},       {">", GREATER},     {"=", EQUAL}};
+    for (const auto &prefix : prefixes)
+    {
+        if (text.substr(0, strlen(prefix.prefix)) == prefix.prefix)
+        {
+            comparison = prefix.comparison;
+            text.remove_prefix(strlen(prefix.prefix));
+            break;
+        }
+    }
+    key = lookupKey(text);
+}
+
+bool Criterion::compare(const Cell &cell, int &order) const
+{
+    std::string cellKey = lookupKey(cell);
+    if (cellKey.empty() || key.empty() || cellKey[0] != key[0])
+    {
+        return false; // Empty, or a number against text
+    }
+    if (key[0] == '#')
+    {
+        double number, value; // Keys hold the number as formatNumber wrote it
+        parseNumber(std::string_view(key).substr(1), number);
+        parseNumber(std::string_view(cellKey).substr(1), value);
+        order = value < number ? -1 : value > number ? 1 : 0;
+        return true;
+    }
+    int text = cellKey.compare(key); // Both upper case behind the same "'"
+    order = text < 0 ? -1 : text > 0 ? 1 : 0;
+    return true;
+}
+
+bool Criterion::matches(const Cell &cell) const
+{
+    if (comparison == NOT_EQUAL)
+    {
+        std::string cellKey = lookupKey(cell);
+        return !cellKey.empty() && !key.empty() && cellKey != key;
+    }
+    int order;
+    if (!compare(cell, order))
+    {
+        return false;
+    }
+    switch (comparison)
+    {
+    case EQUAL:
+        return order == 0;
+    case LESS:
+        return order < 0;
+    case LESS_EQUAL:
+        return order <= 0;
+    case GREATER:
+        return order > 0;
+    default:
+        return order >= 0;
+    }
+}
+
+ColumnIndex::ColumnIndex(const Spreadsheet &sheet, int column, unsigned builtAt) : version(builtAt)
+{
+    for (int i = 0; i < sheet.totalrows; i++)
+    {
+        const Cell *cell = sheet.findCell(i, column);
+        if (cell && !cell->getvalue().empty())
+        {
+            rows[lookupKey(*cell)].push_back(i);
+        }
+    }
+}
+
+std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator>
+ColumnIndex::find(const std::string &key, int firstRow, int lastRow) const
+{
+    auto found = rows.find(key);
+    if (found == rows.end())
+    {
+        static const std::vector<int> none;
+        return {none.end(), none.end()};
+    }
+    const std::vector<int> &list = found->second;
+    return {std::lower_bound(list.begin(), list.end(), firstRow), std::upper_bound(list.begin(), list.end(), lastRow)};
+}
+
+int ColumnIndex::first(const std::string &key, int firstRow, int lastRow) const
+{
+    auto [begin, end] = find(key, firstRow, lastRow);
+    return begin == end ? -1 : *begin;
+}
+
+int ColumnIndex::count(const std::string &key, int firstRow, int lastRow) const
+{
+    auto [begin, end] = find(key, firstRow, lastRow);
+    return (int)(end - begin);
+}
+
+size_t ColumnIndex::memoryBytes() const
+{
+    // Each node holds the entry, the next pointer and the cached hash
+    size_t bytes = sizeof(*this) + rows.bucket_count() * sizeof(void *);
+    for (const auto &[key, list] : rows)
+    {
+        bytes += sizeof(std::pair<const std::string, std::vector<int>>) + 2 * sizeof(void *);
+        bytes += stringHeapBytes(key) + list.capacity() * sizeof(int);
+    }
+    return bytes;
+}
@@ -0,0 +1,58 @@
+#ifndef LOOKUPINDEX_H
+#define LOOKUPINDEX_H
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "cell.h"
+
+class Spreadsheet;
+
+// Key a cell is matched by in lookups: numbers by value ("2" matches "2.0"),
+// text without regard to case. Empty cells have an empty key and never match.
+std::string lookupKey(const Cell &cell);
+std::string lookupKey(std::string_view text); // Same rules for a literal typed in a formula
+
+// A COUNTIF/SUMIF criterion such as "5", "=apple", "<>0", ">=10" or "<m". Numbers compare
+// with numbers and text with text, ignoring case; empty cells never match.
+class Criterion
+{
+public:
+    enum Comparison
+    {
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL
+    };
+
+    Comparison comparison = EQUAL;
+    std::string key; // lookupKey of the operand, empty if there is none
+
+    explicit Criterion(std::string_view text); // Operator prefix, then the operand
+    bool matches(const Cell &cell) const;
+    // Order of cell against the operand, for approximate lookups; false if they do not compare
+    bool compare(const Cell &cell, int &order) const;
+};
+
+// Rows of one column grouped by lookup key, built by Spreadsheet::columnIndex()
+class ColumnIndex
+{
+private:
+    std::unordered_map<std::string, std::vector<int>> rows; // Ascending row numbers per key
+
+public:
+    unsigned version; // Column write count the index was built at
+
+    ColumnIndex(const Spreadsheet &sheet, int column, unsigned builtAt);
+    int first(const std::string &key, int firstRow, int lastRow) const; // -1 if no row matches
+    int count(const std::string &key, int firstRow, int lastRow) const;
+    size_t memoryBytes() const; // Keys, row lists and hash table nodes
+    // Matching rows in firstRow..lastRow, in order
+    std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator>
+    find(const std::string &key, int firstRow, int lastRow) const;
+};
+
+#endif
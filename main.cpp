@@ -1,131 +1,264 @@
 #include "sheet.h"
-#include "formulaparser.h"
+#include "workbook.h"
 #include "file.h"
+#include "bulkedit.h"
+#include "server.h"
+#include "sortfilter.h"
+#include "autosave.h"
 
-// Function to handle user input and update the spreadsheet accordingly
-int handleInput(char key, Spreadsheet &sheet, formulaparser &parser, File &fileHandler, AnsiTerminal &terminal) {
-    static int currentCol = 0;     // Tracks the current column position
-    static int currentRow = 0;     // Tracks the current row position
-    static int colCounter = 0;     // Tracks additional columns beyond initial setup
-    static int rowCounter = 1;     // Tracks additional rows beyond initial setup
-    static char columnStart = 'A'; // Tracks the starting column letter
+#define MAX_BATCH_KEYS 256 // Keys applied before the screen is drawn, even if more are waiting
 
+// What a batch of keys changed on the screen
+struct ScreenUpdate {
+    bool full = false;    // Resized, or the grid moved sideways: draw everything
+    bool headers = false; // Scrolled: new row numbers and column names
+};
+
+static bool goingTo = false; // Alt+g typed, reading the address to go to
+static std::string goToTarget;
+static std::string statusMessage; // Shown in place of the cell value until the next key
+
+// Draw the screen once for a whole batch of keys
+void render(Spreadsheet &sheet, Viewport &view, AnsiTerminal &terminal, const ScreenUpdate &update) {
+    if (update.full) {
+        int termRows, termCols;
+        if (terminal.windowSize(termRows, termCols))
+            view.fitTerminal(termRows, termCols);
+        terminal.clearScreen();
+    }
+    if (update.full || update.headers) {
+        sheet.printrows(terminal, view);
+        sheet.printcoloumns(terminal, view);
+    }
+    sheet.printchart(terminal, view);
+    std::string status = goingTo ? "Go to: " + goToTarget : statusMessage;
+    if (!status.empty()) {
+        status.resize(std::max((int)status.size(), view.width()), ' ');
+        terminal.printAt(3, 1, status, 0);
+    }
+    terminal.flush();
+}
+
+// Function to handle user input and update the spreadsheet accordingly.
+// Only the sheet and the viewport change here; recalculation and drawing wait for the end of the batch.
+int handleInput(char key, Spreadsheet &sheet, Workbook &book, File &fileHandler, AnsiTerminal &terminal, Viewport &view,
+                ScreenUpdate &update) {
+    int labelWidth = view.labelWidth;
+    bool scrolled = false;
+
+    if (key == '\0') {
+        return 1; // An escape sequence we do not handle
+    }
+    statusMessage.clear();
+    // Handle a window resize: the grid is fitted to the new size
+    if (key == KEY_RESIZE) {
+        update.full = true;
+    }
+    // Handle the address typed after Alt+g, Enter jumps there
+    else if (goingTo) {
+        if (key == '\n') {
+            CellAddress address;
+            goingTo = false;
+            if (!goToTarget.empty() && CellAddress::parse(goToTarget, address) == goToTarget.size())
+                scrolled = view.goTo(address.row(), address.column());
+        } else if (key == '~') {
+            if (!goToTarget.empty())
+                goToTarget.pop_back();
+        } else if (isprint((unsigned char)key)) {
+            goToTarget += key;
+        }
+    }
     // Handle navigation and special keys
-    if (key == '\x18' || key == '\x19' || key == '\x1A' || key == '\x1B' || key == '"') {
+    else if (key == '\x18' || key == '\x19' || key == '\x1A' || key == '\x1B' || key == '"' ||
+             key == KEY_PAGE_UP || key == KEY_PAGE_DOWN) {
         switch (key) {
         case '\x18': // Arrow Up
-            currentRow -= 1;
+            scrolled = view.moveCursor(-1, 0);
             break;
         case '\x19': // Arrow Down
-            currentRow += 1;
+            scrolled = view.moveCursor(1, 0);
             break;
         case '\x1A': // Arrow Right
-            currentCol += 1;
+            scrolled = view.moveCursor(0, 1);
             break;
         case '\x1B': // Arrow Left
-            currentCol -= 1;
+            scrolled = view.moveCursor(0, -1);
+            break;
+        case KEY_PAGE_UP:
+            scrolled = view.moveCursor(-view.rows, 0);
+            break;
+        case KEY_PAGE_DOWN:
+            scrolled = view.moveCursor(view.rows, 0);
             break;
         case '\"':   // Save and exit
+            book.recalculate(); // Edits earlier in the batch are not calculated yet
             fileHandler.save_file(sheet);
             terminal.clearScreen();
+            terminal.flush();
             return 0; // Exit program
         }
-
-        // Handle column boundary conditions
-        if (currentCol > INIT_COLUMN - 1) {
-            currentCol--;
-            colCounter++;
-            columnStart = 'A' + colCounter;
-            sheet.totalcols++;
-            sheet.resizes(sheet.totalrows, sheet.totalcols);
-            sheet.printrows(terminal, columnStart, sheet.totalcols, colCounter);
-        } else if (currentCol < 0) {
-            currentCol++;
-            if (columnStart != 'A') {
-                colCounter--;
-                columnStart = 'A' + colCounter;
-                sheet.printrows(terminal, columnStart, sheet.totalcols, colCounter);
-            }
-        } else if (currentCol <= INIT_COLUMN - 1) {
-            sheet.printrows(terminal, columnStart, sheet.totalcols, colCounter);
-        }
-
-        // Handle row boundary conditions
-        if (currentRow > INIT_ROW - 1) {
-            currentRow--;
-            rowCounter++;
-            sheet.totalrows++;
-            sheet.resizes(sheet.totalrows, sheet.totalcols);
-            sheet.printcoloumns(terminal, rowCounter, sheet.totalrows);
-        } else if (currentRow < 0) {
-            currentRow++;
-            if (rowCounter != 1) {
-                rowCounter--;
-                sheet.printcoloumns(terminal, rowCounter, sheet.totalrows);
-            }
-        }
-
-        if (currentRow <= INIT_ROW - 1) {
-            sheet.printcoloumns(terminal, rowCounter, sheet.totalrows);
-        }
-    } 
+    }
+    // Handle Alt+g: go to the cell whose address is typed next
+    else if (key == (char)('g' | 0x80)) {
+        goingTo = true;
+        goToTarget.clear();
+    }
+    // Handle Alt+m: show the memory used by the workbook
+    else if (key == (char)('m' | 0x80)) {
+        statusMessage = book.memoryUsage().summary();
+    }
     // Handle backspace key (~) to remove the last character from a cell's value
     else if (key == '~') {
-        auto &cell = sheet.getCell(currentRow + rowCounter - 1, currentCol + colCounter);
-        if (!cell.getvalue().empty()) {
-            cell.getvalue().pop_back(); // Remove the last character
+        auto &cell = sheet.getCell(view.cursorRow, view.cursorCol);
+        const std::string &value = cell.getvalue();
+        if (!value.empty()) {
+            cell.setvalue(value.substr(0, value.size() - 1)); // Remove the last character
+        }
+    }
+    // Handle Alt+d: fill the current cell from the cell above, shifting its references
+    else if (key == (char)('d' | 0x80)) {
+        int row = view.cursorRow, col = view.cursorCol;
+        if (row > 0) {
+            BulkEdit edit(sheet, &book);
+            edit.fillDown(CellRange{CellAddress(row - 1, col), CellAddress(row, col)});
+            edit.commit();
         }
-        sheet.printchart(terminal, rowCounter, colCounter, currentRow, currentCol);
+    }
+    // Handle Alt+s / Alt+S: sort all rows by the current column, ascending / descending
+    else if (key == (char)('s' | 0x80) || key == (char)('S' | 0x80)) {
+        SortKey sortKey{view.cursorCol, key == (char)('S' | 0x80)};
+        book.recalculate(); // Sort on the values of the edits earlier in the batch
+        sortRows(sheet, 0, sheet.totalrows - 1, {sortKey}, &book);
     }
     // Handle regular character input
     else if (key != '\n') {
-        auto &cell = sheet.getCell(currentRow + rowCounter - 1, currentCol + colCounter);
+        auto &cell = sheet.getCell(view.cursorRow, view.cursorCol);
         std::string updatedValue = cell.getvalue() + key;
         cell.setvalue(updatedValue);
     }
     // Handle Enter key to finalize the expression
     else if (key == '\n') {
-        auto &cell = sheet.getCell(currentRow + rowCounter - 1, currentCol + colCounter);
+        auto &cell = sheet.getCell(view.cursorRow, view.cursorCol);
         cell.setexpression(cell.getvalue());
         cell.setvalue(""); // Clear the temporary value after setting the expression
-        parser.parseGrid(sheet); // Recalculate the grid
     }
 
-    // Recalculate the grid after each input
-    parser.parseGrid(sheet);
-
-    // Update the terminal display
-    sheet.printchart(terminal, rowCounter, colCounter, currentRow, currentCol);
+    // The headers only change when the view scrolled, everything moves when the row numbers widen
+    update.full = update.full || view.labelWidth != labelWidth;
+    update.headers = update.headers || scrolled;
     return 1; // Continue the program
 }
 
 // Main function to initialize and run the spreadsheet program
-int main() {
+// Each CSV given on the command line is loaded as Sheet1, Sheet2, ...; Sheet1 is edited.
+// "--autosave <seconds>" sets how often edits are logged for crash recovery (0 turns it off).
+// The log sits next to the edited file as <file>.autosave.wal/.snap ("autosave.*" without a file).
+// "--serve <socket> [files...]" runs the compute server instead of the terminal UI.
+// "--memory <files...>" loads the files, prints where their memory goes and exits.
+// The grid fills the terminal window; Page Up/Down scroll by a screen and Alt+g goes to a typed address.
+int main(int argc, char *argv[]) {
+    int autosaveSeconds = 5;
+    int first = 1; // First argument after the options
+    if (argc >= first + 2 && std::string(argv[first]) == "--autosave") {
+        autosaveSeconds = atoi(argv[first + 1]);
+        first += 2;
+    }
+    if (argc >= first + 2 && std::string(argv[first]) == "--serve") {
+        ComputeServer server(argv[first + 1]);
+        for (int i = first + 2; i < argc; i++) {
+            if (!server.load("Sheet" + std::to_string(i - first - 1), argv[i]))
+                std::cerr << argv[i] << " is larger than the grid, only part of it was loaded\n";
+        }
+        server.run();
+        return 0;
+    }
+    if (argc >= first + 2 && std::string(argv[first]) == "--memory") {
+        Workbook book;
+        File fileHandler;
+        for (int i = first + 1; i < argc; i++) {
+            std::string name = "Sheet" + std::to_string(i - first);
+            if (!fileHandler.read_and_fill(argv[i], book.addSheet(name))) {
+                std::cout << name << " (" << argv[i] << "): cannot read\n";
+                continue;
+            }
+            std::cout << name << " (" << argv[i] << "): heap grew by at most "
+                      << fileHandler.loadPeakHeap - fileHandler.loadStartHeap << " bytes while loading\n";
+            if (fileHandler.truncated)
+                std::cout << name << ": cut to " << MAX_ROWS << " rows and " << MAX_COLUMNS << " columns\n";
+        }
+        book.recalculate();
+        for (int i = 0; i < book.sheetCount(); i++) {
+            std::cout << "\n" << book.sheetName(i) << "\n" << book.getSheet(i).memoryUsage().report();
+        }
+        std::cout << "\nWorkbook\n" << book.memoryUsage().report() << "heap in use  " << heapInUse() << "\n";
+        return 0;
+    }
+
     AnsiTerminal terminal;
     terminal.clearScreen();
 
-    // Initialize the spreadsheet, parser, and file handler
-    Spreadsheet sheet;
-    formulaparser parser;
+    // Initialize the workbook and file handler
+    Workbook book;
     File fileHandler;
+    for (int i = first; i < argc || i == first; i++) {
+        book.addSheet("Sheet" + std::to_string(i - first + 1));
+    }
+    Spreadsheet &sheet = book.getSheet(0);
 
-    // Print the initial spreadsheet layout
-    sheet.printrows(terminal, 'A', sheet.totalcols, 0);
-    sheet.printcoloumns(terminal, 1, sheet.totalrows);
     sheet.start(sheet.totalrows, sheet.totalcols);
 
+    // Fill the sheets from the files given on the command line
+    for (int i = first; i < argc; i++) {
+        if (!fileHandler.read_and_fill(argv[i], book.getSheet(i - first)))
+            statusMessage = "Cannot read " + std::string(argv[i]);
+        else if (fileHandler.truncated)
+            statusMessage = std::string(argv[i]) + " is larger than the grid, only part of it was loaded";
+    }
+
+    // Restore the edits of a session that did not exit cleanly
+    std::unique_ptr<Autosave> autosave;
+    if (autosaveSeconds > 0) {
+        // Named after the edited file, so a crash of one file is never replayed onto another
+        std::string base = first < argc ? std::string(argv[first]) + ".autosave" : "autosave";
+        autosave = std::make_unique<Autosave>(sheet, base, autosaveSeconds);
+        autosave->recover(); // Recalculated with everything else below
+    }
+
+    // Print the initial spreadsheet layout
+    book.recalculate();
+    Viewport view;
+    ScreenUpdate initial;
+    initial.full = true;
+    render(sheet, view, terminal, initial);
+
     char key;
     int control = 0;
 
     // Uncomment this line to pre-fill the spreadsheet with data from a file
     //fileHandler.read_and_fill("fill.csv", sheet);
 
-    // Main input loop
+    // Main input loop: apply every key already typed or pasted, then recalculate and draw once
     while (true) {
-        key = terminal.getSpecialKey(); // Get user input
-        control = handleInput(key, sheet, parser, fileHandler, terminal);
-        if (!control)
+        ScreenUpdate update;
+        int keys = 0;
+        // While the user is idle the edits still reach the log once the interval passes
+        while (autosave && !terminal.waitForInput(autosave->millisecondsToSave()))
+            autosave->tick();
+        do {
+            key = terminal.getSpecialKey(); // Get user input
+            control = handleInput(key, sheet, book, fileHandler, terminal, view, update);
+        } while (control && ++keys < MAX_BATCH_KEYS && terminal.keyPending());
+        if (!control) {
+            if (autosave)
+                autosave->discard(); // Saved on a clean exit, nothing to recover
             return 0; // Exit if the user chooses to quit
+        }
+
+        // Recalculate the sheets changed by this batch and the sheets reading from them
+        book.recalculate();
+        render(sheet, view, terminal, update);
+        if (autosave)
+            autosave->tick();
     }
 
     // Save the final state and clear the terminal on exit
@@ -0,0 +1,69 @@
+#include "memoryusage.h"
+#include <malloc.h>
+#include <sstream>
+
+double MemoryUsage::bytesPerCell() const
+{
+    return usedCells ? (double)total() / usedCells : 0.0;
+}
+
+MemoryUsage &MemoryUsage::operator+=(const MemoryUsage &other)
+{
+    values += other.values;
+    expressions += other.expressions;
+    grid += other.grid;
+    caches += other.caches;
+    indexes += other.indexes;
+    cells += other.cells;
+    usedCells += other.usedCells;
+    return *this;
+}
+
+std::string MemoryUsage::report() const
+{
+    std::ostringstream out;
+    out << "values       " << values << "\n"
+        << "expressions  " << expressions << "\n"
+        << "grid         " << grid << "\n"
+        << "caches       " << caches << "\n"
+        << "indexes      " << indexes << "\n"
+        << "total        " << total() << "\n"
+        << "cells        " << usedCells << " used of " << cells << " allocated\n"
+        << "per cell     " << bytesPerCell() << " bytes per used cell, "
+        << (cells ? (double)grid / cells : 0.0) << " of them grid\n";
+    return out.str();
+}
+
+std::string MemoryUsage::summary(char separator) const
+{
+    std::ostringstream out;
+    out << "values=" << values << separator << "expressions=" << expressions << separator
+        << "grid=" << grid << separator << "caches=" << caches << separator
+        << "indexes=" << indexes << separator << "total=" << total() << separator
+        << "cells=" << usedCells << separator << "bytes/cell=" << bytesPerCell();
+    return out.str();
+}
+
+size_t stringHeapBytes(const std::string &text)
+{
+    const char *data = text.data();
+    const char *object = reinterpret_cast<const char *>(&text);
+    if (data >= object && data < object + sizeof(std::string))
+    {
+        return 0; // Short text is kept inside the string itself
+    }
+    return text.capacity() + 1;
+}
+
+size_t heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd; // Small blocks in use plus large mmapped ones
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    return (unsigned)info.uordblks + (unsigned)info.hblkhd;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+#include <cstddef>
+#include <string>
+
+// Bytes held by a sheet or a workbook, by what they are spent on. Sizes are what was asked
+// from malloc; its own bookkeeping per allocation is not included.
+struct MemoryUsage
+{
+    size_t values = 0;      // Display text of the cells
+    size_t expressions = 0; // Typed input and formulas
+    size_t grid = 0;        // Cell objects, row vectors, row blocks and the block table
+    size_t caches = 0;      // Column write counters, the autosave journal, workbook dependencies
+    size_t indexes = 0;     // Lookup tables built for VLOOKUP, MATCH, COUNTIF and SUMIF
+    size_t cells = 0;       // Cells allocated in the grid
+    size_t usedCells = 0;   // Cells holding a value or an expression
+
+    size_t total() const { return values + expressions + grid + caches + indexes; }
+    double bytesPerCell() const; // Everything divided over the used cells
+    MemoryUsage &operator+=(const MemoryUsage &other);
+    std::string report() const;                      // One category per line
+    std::string summary(char separator = ' ') const; // One line of name=bytes fields
+};
+
+size_t stringHeapBytes(const std::string &text); // 0 while the text fits inside the string object
+size_t heapInUse();                               // Bytes malloc has handed out and not got back
+
+#endif
@@ -0,0 +1,51 @@
+#include "numberformat.h"
+#include <charconv>
+#include <cctype>
+
+// Skip what std::stod/std::stoi accept before the digits but std::from_chars does not
+static const char *skipPrefix(const char *first, const char *last)
+{
+    while (first != last && isspace((unsigned char)*first))
+    {
+        first++;
+    }
+    if (first != last && *first == '+' && first + 1 != last && first[1] != '-')
+    {
+        first++;
+    }
+    return first;
+}
+
+bool parseNumber(std::string_view text, double &result)
+{
+    const char *last = text.data() + text.size();
+    return std::from_chars(skipPrefix(text.data(), last), last, result).ec == std::errc();
+}
+
+bool parseWholeNumber(std::string_view text, double &result)
+{
+    const char *last = text.data() + text.size();
+    std::from_chars_result parsed = std::from_chars(skipPrefix(text.data(), last), last, result);
+    if (parsed.ec != std::errc())
+    {
+        return false;
+    }
+    while (parsed.ptr != last && isspace((unsigned char)*parsed.ptr))
+    {
+        parsed.ptr++;
+    }
+    return parsed.ptr == last;
+}
+
+bool parseInteger(std::string_view text, int &result)
+{
+    const char *last = text.data() + text.size();
+    return std::from_chars(skipPrefix(text.data(), last), last, result).ec == std::errc();
+}
+
+std::string formatNumber(double number)
+{
+    char buffer[32]; // Enough for the longest shortest-form double
+    std::to_chars_result end = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    return std::string(buffer, end.ptr);
+}
@@ -0,0 +1,18 @@
+#ifndef NUMBERFORMAT_H
+#define NUMBERFORMAT_H
+#include <string>
+#include <string_view>
+
+// Parse the leading number of text like std::stod does ("12abc" -> 12); false if there is none
+bool parseNumber(std::string_view text, double &result);
+
+// Parse text that is a number and nothing else, apart from surrounding spaces
+bool parseWholeNumber(std::string_view text, double &result);
+
+// Parse the leading integer of text like std::stoi does; false if there is none
+bool parseInteger(std::string_view text, int &result);
+
+// Shortest text that reads back as exactly the same double
+std::string formatNumber(double number);
+
+#endif
@@ -0,0 +1,368 @@
+#include "server.h"
+#include "bulkedit.h"
+#include "celladdress.h"
+#include "file.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+#define MAX_GET_CELLS 1048576 // Larger GET ranges are refused rather than answered with one huge line
+
+struct ComputeServer::Client
+{
+    int fd;
+    std::string workbook = "default";
+    std::string input;  // Bytes received but not yet handled
+    std::string output; // Replies not yet written
+    bool closing = false;
+};
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+ComputeServer::ComputeServer(const std::string &path) : socketPath(path)
+{
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        throw std::runtime_error("socket: " + std::string(strerror(errno)));
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str()); // Remove a socket left by an earlier run
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+    {
+        throw std::runtime_error("Cannot listen on " + path + ": " + strerror(errno));
+    }
+    setNonBlocking(listener);
+
+    epoll = epoll_create1(0);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; // The listener is the only entry without a client
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+    openWorkbook("default");
+}
+
+ComputeServer::~ComputeServer()
+{
+    close(epoll);
+    close(listener);
+    unlink(socketPath.c_str());
+}
+
+Workbook &ComputeServer::openWorkbook(const std::string &name)
+{
+    std::unique_ptr<Workbook> &book = workbooks[name];
+    if (!book)
+    {
+        book = std::make_unique<Workbook>();
+        book->addSheet("Sheet1");
+    }
+    return *book;
+}
+
+bool ComputeServer::load(const std::string &sheet, const std::string &filename)
+{
+    Workbook &book = openWorkbook("default");
+    Spreadsheet *target = book.findSheetByName(sheet);
+    File file;
+    if (!file.read_and_fill(filename, target ? *target : book.addSheet(sheet)))
+    {
+        throw std::runtime_error("Cannot read " + filename);
+    }
+    book.recalculate();
+    return !file.truncated;
+}
+
+void ComputeServer::run()
+{
+    epoll_event events[MAX_EVENTS];
+    while (true)
+    {
+        int count = epoll_wait(epoll, events, MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR)
+        {
+            throw std::runtime_error("epoll_wait: " + std::string(strerror(errno)));
+        }
+        for (int i = 0; i < count; i++)
+        {
+            Client *client = (Client *)events[i].data.ptr;
+            if (!client)
+            {
+                acceptClients();
+                continue;
+            }
+
+            bool open = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                open = readClient(*client);
+            }
+            if (open)
+            {
+                open = writeClient(*client) && !(client->closing && client->output.empty());
+            }
+
+            if (!open)
+            {
+                epoll_ctl(epoll, EPOLL_CTL_DEL, client->fd, nullptr);
+                close(client->fd);
+                delete client;
+                continue;
+            }
+
+            // Only wait for writability while replies are queued
+            epoll_event event{};
+            event.events = EPOLLIN | (client->output.empty() ? 0u : (uint32_t)EPOLLOUT);
+            event.data.ptr = client;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, client->fd, &event);
+        }
+    }
+}
+
+void ComputeServer::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return; // EAGAIN: nothing more to accept
+        }
+        setNonBlocking(fd);
+        Client *client = new Client();
+        client->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+bool ComputeServer::readClient(Client &client)
+{
+    char buffer[READ_CHUNK];
+    bool open = true;
+    while (true)
+    {
+        ssize_t length = read(client.fd, buffer, sizeof(buffer));
+        if (length > 0)
+        {
+            client.input.append(buffer, length);
+            continue;
+        }
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length == 0 || errno != EAGAIN)
+        {
+            open = false; // Peer closed; still answer what it sent
+        }
+        break;
+    }
+    handleBatch(client);
+    writeClient(client);
+    return open;
+}
+
+bool ComputeServer::writeClient(Client &client)
+{
+    size_t written = 0;
+    while (written < client.output.size())
+    {
+        // MSG_NOSIGNAL: a client that hung up gives EPIPE instead of killing the server with SIGPIPE
+        ssize_t length = send(client.fd, client.output.data() + written, client.output.size() - written,
+                              MSG_NOSIGNAL);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            return false;
+        }
+        written += length;
+    }
+    client.output.erase(0, written);
+    return true;
+}
+
+// Handle every complete line received so far. SETs are staged per sheet and committed
+// together right before anything that reads results, and at the end of the batch.
+void ComputeServer::handleBatch(Client &client)
+{
+    std::map<Spreadsheet *, std::unique_ptr<BulkEdit>> pending;
+    Workbook *book = &openWorkbook(client.workbook);
+
+    auto commitPending = [&]() {
+        for (auto &[sheet, edit] : pending)
+        {
+            edit->commit();
+        }
+        pending.clear();
+    };
+
+    // Split "Sheet2!A1" into its sheet (first sheet by default) and the rest
+    auto resolve = [&](std::string_view &reference) -> Spreadsheet * {
+        size_t bang = reference.find('!');
+        if (bang == std::string_view::npos)
+        {
+            return &book->getSheet(0);
+        }
+        Spreadsheet *sheet = book->findSheetByName(reference.substr(0, bang));
+        reference.remove_prefix(bang + 1);
+        return sheet;
+    };
+
+    size_t start = 0;
+    for (size_t end = client.input.find('\n'); end != std::string::npos && !client.closing;
+         start = end + 1, end = client.input.find('\n', start))
+    {
+        std::string_view line(client.input.data() + start, end - start);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        size_t space = line.find(' ');
+        std::string_view command = line.substr(0, space);
+        std::string_view argument = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+
+        if (command == "SET")
+        {
+            size_t split = argument.find(' ');
+            std::string_view reference = argument.substr(0, split);
+            std::string text(split == std::string_view::npos ? std::string_view() : argument.substr(split + 1));
+            Spreadsheet *sheet = resolve(reference);
+            CellAddress address;
+            if (!sheet || CellAddress::parse(reference, address) != reference.size() || reference.empty())
+            {
+                client.output += "ERR bad reference\n";
+                continue;
+            }
+            std::unique_ptr<BulkEdit> &edit = pending[sheet];
+            if (!edit)
+            {
+                edit = std::make_unique<BulkEdit>(*sheet, book);
+            }
+            edit->setCell(address.row(), address.column(), text);
+            client.output += "OK\n";
+        }
+        else if (command == "GET")
+        {
+            commitPending();
+            std::string_view reference = argument;
+            Spreadsheet *sheet = resolve(reference);
+            CellRange range;
+            CellAddress address;
+            if (sheet && !reference.empty() && CellAddress::parse(reference, address) == reference.size())
+            {
+                range = CellRange{address, address};
+            }
+            else if (!sheet || !CellRange::parse(reference, range))
+            {
+                client.output += "ERR bad reference\n";
+                continue;
+            }
+            long long cells = (long long)(range.last.row() - range.first.row() + 1) *
+                              (range.last.column() - range.first.column() + 1);
+            if (cells > MAX_GET_CELLS)
+            {
+                client.output += "ERR range too large\n";
+                continue;
+            }
+            const Spreadsheet &view = *sheet;
+            client.output += "OK";
+            for (int i = range.first.row(); i <= range.last.row(); i++)
+            {
+                for (int j = range.first.column(); j <= range.last.column(); j++)
+                {
+                    const Cell *cell = view.findCell(i, j);
+                    client.output += '\t';
+                    if (cell)
+                        client.output += cell->getvalue();
+                }
+            }
+            client.output += '\n';
+        }
+        else if (command == "RECALC")
+        {
+            commitPending();
+            book->recalculate();
+            client.output += "OK\n";
+        }
+        else if (command == "MEM")
+        {
+            commitPending();
+            const Spreadsheet *sheet = argument.empty() ? nullptr : book->findSheetByName(argument);
+            if (!argument.empty() && !sheet)
+            {
+                client.output += "ERR unknown sheet\n";
+                continue;
+            }
+            MemoryUsage usage = sheet ? sheet->memoryUsage() : book->memoryUsage();
+            client.output += "OK\t" + usage.summary('\t') + "\n";
+        }
+        else if (command == "USE" && !argument.empty())
+        {
+            commitPending();
+            client.workbook = std::string(argument);
+            book = &openWorkbook(client.workbook);
+            client.output += "OK\n";
+        }
+        else if (command == "LOAD")
+        {
+            commitPending();
+            size_t split = argument.find(' ');
+            if (split == std::string_view::npos)
+            {
+                client.output += "ERR usage: LOAD <sheet> <file>\n";
+                continue;
+            }
+            std::string name(argument.substr(0, split)), filename(argument.substr(split + 1));
+            if (!isSheetName(name))
+            {
+                client.output += "ERR bad sheet name\n"; // Formulas could not refer to it
+                continue;
+            }
+            Spreadsheet *sheet = book->findSheetByName(name);
+            File file;
+            // A file that cannot be opened adds no sheet; one that fails later leaves it empty
+            if ((!sheet && access(filename.c_str(), R_OK) != 0) ||
+                !file.read_and_fill(filename, sheet ? *sheet : book->addSheet(name)))
+            {
+                client.output += "ERR cannot read " + filename + "\n";
+                continue;
+            }
+            book->recalculate();
+            client.output += file.truncated ? "OK\ttruncated\n" : "OK\n";
+        }
+        else if (command == "QUIT")
+        {
+            client.closing = true;
+        }
+        else if (!command.empty())
+        {
+            client.output += "ERR unknown command\n";
+        }
+    }
+    commitPending();
+    client.input.erase(0, start);
+}
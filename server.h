@@ -0,0 +1,47 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include <map>
+#include <memory>
+#include <string>
+#include "workbook.h"
+
+// Serves workbooks over a Unix domain socket with a line protocol, one reply line per request:
+//   USE <book>               select (or create) a workbook for this connection -> OK
+//   LOAD <sheet> <file.csv>  fill a sheet of the current workbook from a file   -> OK
+//                            (sheet names are a letter followed by letters and digits;
+//                            ERR cannot read <file> if it cannot be opened)
+//                            (OK\ttruncated if the file exceeds the grid; the rest is skipped)
+//   SET <ref> <text>         set a cell, "=..." is a formula, Sheet2!A1 allowed -> OK
+//   GET <ref or A1..B9>      cell values in row order, tab separated            -> OK\t<v>...
+//                            (at most 1048576 cells, else ERR range too large)
+//   RECALC                   recalculate changed sheets and the sheets reading   -> OK
+//                            from them; sheets with nothing new are up to date
+//   MEM [sheet]              bytes used by the workbook or one sheet            -> OK\tvalues=<n>...
+//   QUIT                     close the connection
+// Errors reply "ERR <reason>". Clients may pipeline requests: the SETs in one read
+// are applied as one batch with a single recalculation before any GET sees them.
+class ComputeServer
+{
+private:
+    struct Client;
+
+    std::string socketPath;
+    std::map<std::string, std::unique_ptr<Workbook>> workbooks;
+    int listener;
+    int epoll;
+
+    Workbook &openWorkbook(const std::string &name);
+    void acceptClients();
+    bool readClient(Client &client);  // false once the client should be closed
+    bool writeClient(Client &client); // false on a write error
+    void handleBatch(Client &client);
+
+public:
+    ComputeServer(const std::string &path);
+    ~ComputeServer();
+    // Into the "default" workbook; false if truncated, throws std::runtime_error if unreadable
+    bool load(const std::string &sheet, const std::string &filename);
+    void run(); // Serve until the process is stopped
+};
+
+#endif
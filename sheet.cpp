@@ -1,25 +1,25 @@
 #include "sheet.h"
-// Initialize all cells with default values
+#include "celladdress.h"
+#include "lookupindex.h"
+// Initialize all cells with default values; cells never written are already empty
 void Spreadsheet::start(int currentRows, int columns)
 {
     for (int i = 0; i < currentRows; i++)
     {
-        for (int j = 0; j < columns; j++)
+        int allocated = std::min(columns, (int)getRow(i).size());
+        for (int j = 0; j < allocated; j++)
         {
-            chart[i][j].setvalue("");
-            chart[i][j].setexpression("");
+            getCell(i, j).setvalue("");
+            getCell(i, j).setexpression("");
         }
     }
 }
 
 // Constructor with specified dimensions
 Spreadsheet::Spreadsheet(int currentRows, int columns)
+    : blocks(std::make_shared<BlockTable>()), dirty(true), journaling(false), journalFull(false)
 {
-    chart.resize(currentRows);
-    for (int i = 0; i < currentRows; i++)
-    {
-        chart[i].resize(columns);
-    }
+    resizes(currentRows, columns);
     totalrows = currentRows;
     totalcols = columns;
     start(currentRows, columns); // Initialize all cells
@@ -27,154 +27,333 @@ Spreadsheet::Spreadsheet(int currentRows, int columns)
 
 
 Spreadsheet::~Spreadsheet(){
-    chart.clear();
+    blocks.reset();
 }
 
+// Make the block table private to this sheet before changing it
+BlockTable &Spreadsheet::writableTable()
+{
+    if (blocks.use_count() > 1)
+    {
+        blocks = std::make_shared<BlockTable>(*blocks); // Copies block pointers only
+    }
+    return *blocks;
+}
 
-// Resize the spreadsheet dynamically
-void Spreadsheet::resizes(int rows, int columns)
+// Make the block holding the row private to this sheet before changing it,
+// creating the block on its first write
+std::vector<Cell> &Spreadsheet::writableRow(int row)
 {
-    if (rows > chart.size())
+    dirty = true;
+    BlockTable &table = writableTable();
+    if (row / BLOCK_ROWS >= (int)table.size())
     {
-        chart.resize(rows);
+        table.resize(row / BLOCK_ROWS + 1);
     }
-    for (int i = 0; i < rows; i++)
+    std::shared_ptr<RowBlock> &block = table[row / BLOCK_ROWS];
+    if (!block)
     {
-        if (columns > chart[i].size())
-        {
-            chart[i].resize(columns);
-        }
+        block = std::make_shared<RowBlock>();
+        block->rows.resize(BLOCK_ROWS);
+    }
+    else if (block.use_count() > 1)
+    {
+        block = std::make_shared<RowBlock>(*block); // A snapshot still reads the old block
     }
+    return block->rows[row % BLOCK_ROWS];
+}
+
+// Make room for the given number of rows. Only the block table grows here;
+// cells are allocated when they are first written.
+void Spreadsheet::resizes(int rows, int /*columns*/)
+{
+    if (rows > (int)blocks->size() * BLOCK_ROWS)
+    {
+        writableTable().resize((rows + BLOCK_ROWS - 1) / BLOCK_ROWS);
+    }
+}
+
+// Rows of the live sheet, read-only; a row never written is empty
+const std::vector<Cell> &Spreadsheet::getRow(int row) const
+{
+    static const std::vector<Cell> emptyRow;
+    if (row < 0 || row / BLOCK_ROWS >= (int)blocks->size() || !(*blocks)[row / BLOCK_ROWS])
+    {
+        return emptyRow;
+    }
+    return (*blocks)[row / BLOCK_ROWS]->rows[row % BLOCK_ROWS];
 }
 
 // Get a specific cell from the spreadsheet
 Cell &Spreadsheet::getCell(int currentRow, int column)
 {
-    if (currentRow < 0 || currentRow >= chart.size() || column < 0 || column >= chart[currentRow].size())
+    Cell &cell = getComputedCell(currentRow, column);
+    columnChanged(column); // The caller may change the cell, so its column index is outdated
+    if (journaling && !journalFull)
+    {
+        journal.push_back(CellAddress(currentRow, column));
+        if (journal.size() > JOURNAL_LIMIT)
+        {
+            journalFull = true;
+            journal.clear();
+        }
+    }
+    return cell;
+}
+
+Cell &Spreadsheet::getComputedCell(int currentRow, int column)
+{
+    if (currentRow < 0 || currentRow >= MAX_ROWS || column < 0 || column >= MAX_COLUMNS)
     {
         throw std::out_of_range("Cell index out of bounds");
     }
-    return chart[currentRow][column];
+    std::vector<Cell> &row = writableRow(currentRow);
+    if (column >= (int)row.size())
+    {
+        row.resize(column + 1);
+    }
+    totalrows = std::max(totalrows, currentRow + 1); // Written cells are always inside the sheet
+    totalcols = std::max(totalcols, column + 1);
+    return row[column];
 }
 
-// Print row headers (column letters)
-void Spreadsheet::printrows(AnsiTerminal &terminal, char startChar, int totalrow, int colcounter) const
+void Spreadsheet::columnChanged(int column)
 {
-    // Clear header row
-    for (int i = 0; i < (col_width * INIT_COLUMN) + 4; i++)
+    if (column >= (int)columnWrites.size())
     {
-        terminal.printInvertedAt(1, i);
-        terminal.printInvertedAt(2, i);
+        columnWrites.resize(column + 1);
     }
-    terminal.printInvertedAt(0, 0, "A1");
+    columnWrites[column]++;
+}
 
-    for (int i = 0; i <= (col_width * INIT_COLUMN) + 3; i++)
+const Cell &Spreadsheet::getCell(int currentRow, int column) const
+{
+    static const Cell emptyCell;
+    if (currentRow < 0 || column < 0)
     {
-        terminal.printInvertedAt(4, i);
+        throw std::out_of_range("Cell index out of bounds");
     }
+    const Cell *cell = findCell(currentRow, column);
+    return cell ? *cell : emptyCell;
+}
 
-    // Print column headers
-    for (int col = 0; col < INIT_COLUMN; col++)
+const Cell *Spreadsheet::findCell(int row, int column) const
+{
+    const std::vector<Cell> &cells = getRow(row);
+    if (column < 0 || column >= (int)cells.size())
     {
-        int currentColumn = col + colcounter;
-        decltype(startChar) firstChar, secondChar; //Example decltype usage
+        return nullptr;
+    }
+    return &cells[column];
+}
 
-        if (currentColumn < NUMBER_OF_ALL_LETTERS)
-        {
-            firstChar = 'A' + currentColumn;
-            terminal.printInvertedAt(4, col * col_width + 8, firstChar);
-        }
-        else
-        {
-            firstChar = 'A' + (currentColumn / NUMBER_OF_ALL_LETTERS) - 1;
-            secondChar = 'A' + (currentColumn % NUMBER_OF_ALL_LETTERS);
-            terminal.printInvertedAt(4, col * col_width + 8, firstChar);
-            terminal.printInvertedAt(4, col * col_width + 9, secondChar);
-        }
+// Allocate a row at its final width, so filling it cell by cell never grows it again
+void Spreadsheet::reserveRow(int row, int columns)
+{
+    if (row >= 0 && row < MAX_ROWS)
+    {
+        writableRow(row).reserve(std::min(columns, MAX_COLUMNS));
     }
 }
 
-// Print column headers (row numbers)
-void Spreadsheet::printcoloumns(AnsiTerminal &terminal, int startFrom, int totalcoloumn) const
+// Reorder rows by moving whole rows; the cells themselves are not copied
+void Spreadsheet::permuteRows(int firstRow, const std::vector<int> &order)
 {
-    for (int i = 2; i < INIT_ROW + 2; i++)
+    std::vector<std::vector<Cell>> moved(order.size());
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        moved[k] = std::move(writableRow(order[k]));
+    }
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        writableRow(firstRow + (int)k) = std::move(moved[k]);
+    }
+    for (unsigned &writes : columnWrites)
+    {
+        writes++;
+    }
+    if (journaling)
     {
-        terminal.printInvertedAt(i + 3, 1);
-        terminal.printInvertedAt(i + 3, 2);
-        terminal.printInvertedAt(i + 3, 3);
+        journalFull = true; // Every moved row changed
+        journal.clear();
     }
+}
 
-    for (int i = 0; i < INIT_ROW; i++)
+std::shared_ptr<const ColumnIndex> Spreadsheet::columnIndex(int column) const
+{
+    unsigned version = column < (int)columnWrites.size() ? columnWrites[column] : 0;
+    std::lock_guard<std::mutex> lock(indexLock); // Sheets recalculated together may share a lookup table
+    std::shared_ptr<const ColumnIndex> &index = indexes[column];
+    if (!index || index->version != version)
     {
-        if (startFrom < 10)
+        index = std::make_shared<ColumnIndex>(*this, column, version);
+    }
+    return index;
+}
+
+void Spreadsheet::setJournaling(bool on)
+{
+    journaling = on;
+    journalFull = false;
+    journal.clear();
+}
+
+// Hand over the cells edited since the last call, each listed once
+bool Spreadsheet::takeJournal(std::vector<CellAddress> &edits)
+{
+    edits.clear();
+    bool full = journalFull;
+    journalFull = false;
+    if (!full)
+    {
+        std::sort(journal.begin(), journal.end(),
+                  [](const CellAddress &a, const CellAddress &b) { return a.key() < b.key(); });
+        journal.erase(std::unique(journal.begin(), journal.end()), journal.end());
+        edits.swap(journal);
+    }
+    journal.clear();
+    return full;
+}
+
+// Share the current blocks with a reader; later edits copy only the blocks they touch
+SheetSnapshot Spreadsheet::snapshot() const
+{
+    return SheetSnapshot(blocks, totalrows, totalcols);
+}
+
+// Walk every allocated row; only meant for reports, it costs as much as reading the whole sheet
+MemoryUsage Spreadsheet::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.grid = sizeof(*this) + sizeof(BlockTable) + SHARED_COUNTS_BYTES + blocks->capacity() * sizeof(blocks->front());
+    for (const std::shared_ptr<RowBlock> &block : *blocks)
+    {
+        if (!block)
         {
-            terminal.printInvertedAt(i + 5, 1);
-            terminal.printInvertedAt(i + 5, 2);
-            terminal.printInvertedAt(i + 5, 3, startFrom);
+            continue;
         }
-        else if (startFrom < 100)
+        usage.grid += sizeof(RowBlock) + SHARED_COUNTS_BYTES + block->rows.capacity() * sizeof(std::vector<Cell>);
+        for (const std::vector<Cell> &row : block->rows)
         {
-            terminal.printInvertedAt(i + 5, 1);
-            terminal.printInvertedAt(i + 5, 2, startFrom);
+            usage.grid += row.capacity() * sizeof(Cell);
+            usage.cells += row.size();
+            for (const Cell &cell : row)
+            {
+                usage.values += stringHeapBytes(cell.getvalue());
+                if (!cell.getexpression().empty()) // Kept in its own shared formula
+                {
+                    usage.expressions += SHARED_COUNTS_BYTES + sizeof(Formula) + stringHeapBytes(cell.getexpression())
+                                         + cell.getformula()->calls.capacity() * sizeof(Formula::Call);
+                }
+                if (!cell.getvalue().empty() || !cell.getexpression().empty())
+                {
+                    usage.usedCells++;
+                }
+            }
         }
-        else
+    }
+
+    usage.caches = columnWrites.capacity() * sizeof(unsigned) + journal.capacity() * sizeof(CellAddress);
+    std::lock_guard<std::mutex> lock(indexLock);
+    for (const auto &[column, index] : indexes)
+    {
+        usage.indexes += sizeof(std::pair<const int, std::shared_ptr<const ColumnIndex>>) + 2 * sizeof(void *);
+        if (index)
         {
-            terminal.printInvertedAt(i + 5, 1, startFrom);
+            usage.indexes += SHARED_COUNTS_BYTES + index->memoryBytes();
         }
-        startFrom++;
     }
+    usage.indexes += indexes.bucket_count() * sizeof(void *);
+    return usage;
+}
+
+SheetSnapshot::SheetSnapshot(std::shared_ptr<const BlockTable> table, int totalrow, int totalcol)
+    : blocks(std::move(table)), totalrows(totalrow), totalcols(totalcol)
+{
 }
 
-// Print spreadsheet content
-void Spreadsheet::printchart(AnsiTerminal &terminal, int rowCounter, int colCounter, int currentRow, int currentCol)
+const std::vector<Cell> &SheetSnapshot::getRow(int row) const
 {
-    // Clear all cells
-    for (int i = 0; i < INIT_ROW; i++)
+    static const std::vector<Cell> emptyRow;
+    if (row < 0 || row / BLOCK_ROWS >= (int)blocks->size() || !(*blocks)[row / BLOCK_ROWS])
     {
-        for (int j = 0; j < INIT_COLUMN; j++)
-        {
-            terminal.printAt(i + 5, col_width * j + 4);
-        }
+        return emptyRow;
     }
+    return (*blocks)[row / BLOCK_ROWS]->rows[row % BLOCK_ROWS];
+}
 
-    // Reprint all cells
-    for (int i = 0; i < INIT_ROW; i++)
+const Cell &SheetSnapshot::getCell(int row, int column) const
+{
+    static const Cell emptyCell;
+    const std::vector<Cell> &cells = getRow(row);
+    if (row < 0 || column < 0)
     {
-        for (int j = 0; j < INIT_COLUMN; j++)
-        {
-            int actualRow = i + rowCounter - 1;
-            int actualCol = j + colCounter;
-            terminal.printAt(i + 5, col_width * j + 4, chart[actualRow][actualCol].getvalue());
-        }
+        throw std::out_of_range("Cell index out of bounds");
     }
+    return column < (int)cells.size() ? cells[column] : emptyCell;
+}
 
-    int actualRow = currentRow + rowCounter - 1; // Row counter comes 1 more than its value
-    int actualCol = currentCol + colCounter;
-    for(int i=0; i<col_width*INIT_COLUMN+4; i++)
-        terminal.printAt(3, i, " "); // Clear previous selection
-    terminal.printAt(3, 1, chart[actualRow][actualCol].getvalue(), 0);
+namespace
+{
+    // Cut or pad text to exactly width characters, so printing it also clears what was there
+    std::string fitWidth(const std::string &text, int width)
+    {
+        std::string fitted = text.substr(0, width);
+        fitted.resize(width, ' ');
+        return fitted;
+    }
+}
 
-    char firstChar, secondChar;
+// Print row headers (column letters) for the columns in the viewport
+void Spreadsheet::printrows(AnsiTerminal &terminal, const Viewport &view) const
+{
+    // Clear header rows
+    std::string blank(view.width(), ' ');
+    terminal.printInvertedAt(1, 0, blank, 0);
+    terminal.printInvertedAt(2, 0, blank, 0);
+    terminal.printInvertedAt(0, 0, "A1");
 
-    if (actualCol < NUMBER_OF_ALL_LETTERS)
-    { // Print updated rows and columns as inverted
-        firstChar = 'A' + actualCol;
-        terminal.printInvertedAt(1, 1, firstChar);
-        terminal.printInvertedAt(1, 2, actualRow + 1);
+    // Column names centred over their cells
+    std::string header = blank;
+    for (int col = 0; col < view.cols && view.leftCol + col < MAX_COLUMNS; col++)
+    {
+        std::string_view name = columnName(view.leftCol + col);
+        header.replace(view.screenCol(view.leftCol + col) - 1 + (col_width - (int)name.size()) / 2, name.size(), name);
     }
-    else
+    terminal.printInvertedAt(4, 1, header, 0);
+}
+
+// Print column headers (row numbers) for the rows in the viewport
+void Spreadsheet::printcoloumns(AnsiTerminal &terminal, const Viewport &view) const
+{
+    for (int i = 0; i < view.rows; i++)
     {
-        firstChar = 'A' + (actualCol / NUMBER_OF_ALL_LETTERS) - 1;
-        secondChar = 'A' + (actualCol % NUMBER_OF_ALL_LETTERS);
-        terminal.printInvertedAt(1, 1, firstChar);
-        terminal.printInvertedAt(1, 2, secondChar);
-        terminal.printInvertedAt(1, 3, actualRow + 1);
+        std::string label = std::to_string(view.topRow + i + 1);
+        label.insert(0, std::max(0, view.labelWidth - (int)label.size()), ' '); // Right aligned
+        terminal.printInvertedAt(view.screenRow(view.topRow + i), 1, label, 0);
     }
+}
 
-    for (int j = 0; j < col_width; j++)
-    { // Print white screen to the place of current cell
-        terminal.printInvertedAt(currentRow + 5, col_width * currentCol + 4 + j);
+// Print the cells in the viewport; cells outside it are never read
+void Spreadsheet::printchart(AnsiTerminal &terminal, const Viewport &view) const
+{
+    for (int i = 0; i < view.rows; i++)
+    {
+        int actualRow = view.topRow + i;
+        const std::vector<Cell> &cells = getRow(actualRow);
+        for (int j = 0; j < view.cols; j++)
+        {
+            int actualCol = view.leftCol + j;
+            const std::string &value = actualCol < (int)cells.size() ? cells[actualCol].getvalue() : std::string();
+            terminal.printAt(view.screenRow(actualRow), view.screenCol(actualCol), fitWidth(value, col_width));
+        }
     }
+
+    // Value of the current cell in full, then its address as inverted
+    const Cell &current = getCell(view.cursorRow, view.cursorCol);
+    terminal.printAt(3, 1, fitWidth(current.getvalue(), view.width()), 0);
+    terminal.printInvertedAt(1, 1, fitWidth(CellAddress(view.cursorRow, view.cursorCol).toString(), col_width));
+
     // Print the currently selected cell
-    terminal.printInvertedAt(currentRow + 5, col_width * currentCol + 4, chart[currentRow + rowCounter - 1][currentCol + colCounter].getvalue());
+    terminal.printInvertedAt(view.screenRow(view.cursorRow), view.screenCol(view.cursorCol), fitWidth(current.getvalue(), col_width));
 }
@@ -1,22 +1,81 @@
 #ifndef SHEET_H
 #define SHEET_H
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "AnsiTerminal.h"
 #include "cell.h"
+#include "celladdress.h"
+#include "memoryusage.h"
+#include "viewport.h"
+
+#define BLOCK_ROWS 64 // Rows per copy-on-write block
+#define JOURNAL_LIMIT (1 << 20) // Edits remembered before the journal asks for a full save
+#define SHARED_COUNTS_BYTES 16  // Use and weak counts with their vtable, stored next to a make_shared object
+
+// A run of BLOCK_ROWS rows, shared between the live sheet and its snapshots.
+// Blocks no cell was written to are null in the table.
+struct RowBlock
+{
+    std::vector<std::vector<Cell>> rows;
+};
+typedef std::vector<std::shared_ptr<RowBlock>> BlockTable;
+
+class ColumnIndex;
+
+// Immutable view of a sheet at the moment it was taken.
+// Copying is cheap and a snapshot may be read from any thread.
+class SheetSnapshot
+{
+private:
+    std::shared_ptr<const BlockTable> blocks;
+
+public:
+    SheetSnapshot(std::shared_ptr<const BlockTable> table, int totalrow, int totalcol);
+    int totalrows, totalcols;
+    const std::vector<Cell> &getRow(int row) const;
+    const Cell &getCell(int row, int column) const;
+};
+
 class Spreadsheet
 {
 private:
-    std::vector<std::vector<Cell>> chart;
+    std::shared_ptr<BlockTable> blocks; // Rows grouped in blocks of BLOCK_ROWS
+    bool dirty;                         // Written since the last recalculation
+    std::vector<unsigned> columnWrites; // Write count per column, outdates lookup indexes
+    mutable std::mutex indexLock;
+    mutable std::unordered_map<int, std::shared_ptr<const ColumnIndex>> indexes;
+    bool journaling;                    // Remember edited cells for the autosave log
+    bool journalFull;                   // Too much changed to list, everything must be saved
+    std::vector<CellAddress> journal;
+    BlockTable &writableTable();
+    std::vector<Cell> &writableRow(int row);
 public:
     Spreadsheet(int row = INIT_ROW, int col = INIT_COLUMN);
     ~Spreadsheet();
     int totalrows, totalcols;
     void resizes(int row, int coloumn);
-    void printrows(AnsiTerminal &terminal, char starthere, int totalrow, int colcounter) const;
-    void printcoloumns(AnsiTerminal &terminal, int startfrom, int totalcoloumn) const;
-    void printchart(AnsiTerminal &terminal, int rowCounter, int colCounter, int currentRow, int currentCol);
+    void printrows(AnsiTerminal &terminal, const Viewport &view) const;
+    void printcoloumns(AnsiTerminal &terminal, const Viewport &view) const;
+    void printchart(AnsiTerminal &terminal, const Viewport &view) const;
     void start(int currentrows, int coloumns);
-    Cell &getCell(int currentrow, int coloumn);
+    const std::vector<Cell> &getRow(int row) const;
+    Cell &getCell(int currentrow, int coloumn);             // Allocates the cell, copies its block if a snapshot shares it
+    Cell &getComputedCell(int row, int column);             // Same, for formula results: not journaled as an edit
+    void columnChanged(int column);                         // Outdate the lookup index after a cell of column changed
+    const Cell &getCell(int currentrow, int coloumn) const; // Read-only access, never allocates or copies
+    const Cell *findCell(int row, int column) const;        // nullptr for cells never written
+    void reserveRow(int row, int columns);                  // Room for columns cells before they are written
+    bool isDirty() const { return dirty; }
+    void clearDirty() { dirty = false; }
+    void permuteRows(int firstRow, const std::vector<int> &order); // Row firstRow + k takes old row order[k]
+    // Lookup index of a column, built on first use and again after the column is written
+    std::shared_ptr<const ColumnIndex> columnIndex(int column) const;
+    void setJournaling(bool on);
+    bool takeJournal(std::vector<CellAddress> &edits); // true if the whole sheet must be saved instead
+    SheetSnapshot snapshot() const;                         // O(1), must be called from the editing thread
+    MemoryUsage memoryUsage() const;                        // Blocks shared with snapshots count in full
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "sortfilter.h"
+#include "celladdress.h"
+#include "formulaparser.h"
+#include "workbook.h"
+#include <algorithm>
+#include <thread>
+
+#define PARALLEL_SORT_MIN_ROWS 65536 // Smaller ranges are sorted on one thread
+
+namespace
+{
+    // One key column read once into flat arrays, so comparisons never touch Cell
+    struct KeyColumn
+    {
+        std::vector<unsigned char> kind; // 0 number, 1 text, 2 empty
+        std::vector<double> numbers;
+        std::vector<const std::string *> texts;
+        bool descending;
+    };
+
+    KeyColumn readKey(const Spreadsheet &sheet, int firstRow, int count, const SortKey &key)
+    {
+        static const std::string empty;
+        KeyColumn column;
+        column.kind.resize(count);
+        column.numbers.resize(count);
+        column.texts.resize(count, &empty);
+        column.descending = key.descending;
+        for (int k = 0; k < count; k++)
+        {
+            const Cell *cell = sheet.findCell(firstRow + k, key.column);
+            if (!cell || cell->getvalue().empty())
+            {
+                column.kind[k] = 2;
+            }
+            else if (cell->isnumber())
+            {
+                column.kind[k] = 0;
+                column.numbers[k] = cell->getnumber();
+            }
+            else
+            {
+                column.kind[k] = 1;
+                column.texts[k] = &cell->getvalue();
+            }
+        }
+        return column;
+    }
+
+    // Negative, zero or positive like strcmp; empty cells stay last in both directions
+    int compareKey(const KeyColumn &column, int a, int b)
+    {
+        if (column.kind[a] != column.kind[b])
+        {
+            if (column.kind[a] == 2 || column.kind[b] == 2)
+                return column.kind[a] == 2 ? 1 : -1;
+            return column.descending ? column.kind[b] - column.kind[a] : column.kind[a] - column.kind[b];
+        }
+        int result = 0;
+        if (column.kind[a] == 0)
+            result = column.numbers[a] < column.numbers[b] ? -1 : column.numbers[b] < column.numbers[a] ? 1 : 0;
+        else if (column.kind[a] == 1)
+            result = column.texts[a]->compare(*column.texts[b]);
+        return column.descending ? -result : result;
+    }
+
+    // Stable sort of order: sorted runs on every core, then merged pairwise
+    template <class Less>
+    void parallelStableSort(std::vector<int> &order, Less less)
+    {
+        size_t runs = std::max(1u, std::thread::hardware_concurrency());
+        if (order.size() < PARALLEL_SORT_MIN_ROWS || runs == 1)
+        {
+            std::stable_sort(order.begin(), order.end(), less);
+            return;
+        }
+
+        std::vector<size_t> bounds;
+        for (size_t r = 0; r <= runs; r++)
+        {
+            bounds.push_back(order.size() * r / runs);
+        }
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < runs; r++)
+        {
+            threads.emplace_back([&, r]() {
+                std::stable_sort(order.begin() + bounds[r], order.begin() + bounds[r + 1], less);
+            });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        // Merging a run only with the run right after it keeps equal keys in order
+        for (size_t width = 1; width < runs; width *= 2)
+        {
+            threads.clear();
+            for (size_t r = 0; r + width < runs; r += 2 * width)
+            {
+                size_t first = bounds[r], middle = bounds[r + width], last = bounds[std::min(r + 2 * width, runs)];
+                threads.emplace_back([&order, &less, first, middle, last]() {
+                    std::inplace_merge(order.begin() + first, order.begin() + middle, order.begin() + last, less);
+                });
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+        }
+    }
+
+    // Make references to cells of moved rows follow them, in sheet and in every sheet of book
+    void followMovedRows(Spreadsheet &sheet, int firstRow, const std::vector<int> &order, Workbook *book)
+    {
+        std::vector<int> newRow(order.size());
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            newRow[order[k] - firstRow] = firstRow + (int)k;
+        }
+        int lastRow = firstRow + (int)order.size() - 1;
+        int self = book ? book->indexOf(sheet) : -1;
+
+        auto update = [&](Spreadsheet &formulas, bool own) {
+            const Spreadsheet &view = formulas;
+            for (int i = 0; i < formulas.totalrows; i++)
+            {
+                int allocated = std::min(formulas.totalcols, (int)view.getRow(i).size()); // Cells never written hold no formula
+                for (int j = 0; j < allocated; j++)
+                {
+                    const Cell *cell = view.findCell(i, j);
+                    if (!cell || cell->getexpression().empty() || cell->getexpression()[0] != '=')
+                        continue;
+                    std::string rewritten = rewriteReferences(cell->getexpression(),
+                        [&](const CellAddress &address, std::string_view name, bool corner) {
+                            bool here = name.empty() ? own : self >= 0 && book->findSheet(name) == self;
+                            if (!here || corner || address.row() < firstRow || address.row() > lastRow)
+                                return address; // Ranges keep covering the same rows
+                            return CellAddress(newRow[address.row() - firstRow], address.column(),
+                                               address.absoluteRow(), address.absoluteColumn());
+                        });
+                    if (rewritten != cell->getexpression())
+                        formulas.getCell(i, j).setexpression(rewritten);
+                }
+            }
+        };
+
+        update(sheet, true);
+        for (int s = 0; book && s < book->sheetCount(); s++)
+        {
+            if (s != self)
+                update(book->getSheet(s), false);
+        }
+    }
+
+    void applyOrder(Spreadsheet &sheet, int firstRow, const std::vector<int> &order, Workbook *book)
+    {
+        std::vector<int> rows(order.size());
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            rows[k] = firstRow + order[k];
+        }
+        sheet.permuteRows(firstRow, rows);
+        followMovedRows(sheet, firstRow, rows, book);
+
+        if (book && book->indexOf(sheet) >= 0)
+        {
+            book->recalculate();
+        }
+        else
+        {
+            formulaparser().parseGrid(sheet);
+            sheet.clearDirty();
+        }
+    }
+
+    // Clamp the range to the sheet and make sure every row in it is allocated
+    int prepareRange(Spreadsheet &sheet, int firstRow, int &lastRow)
+    {
+        lastRow = std::min(lastRow, sheet.totalrows - 1);
+        if (firstRow < 0 || lastRow < firstRow)
+        {
+            return 0;
+        }
+        sheet.resizes(lastRow + 1, 0);
+        return lastRow - firstRow + 1;
+    }
+}
+
+void sortRows(Spreadsheet &sheet, int firstRow, int lastRow, const std::vector<SortKey> &keys, Workbook *book)
+{
+    int count = prepareRange(sheet, firstRow, lastRow);
+    if (count < 2 || keys.empty())
+    {
+        return;
+    }
+
+    std::vector<KeyColumn> columns;
+    for (const SortKey &key : keys)
+    {
+        columns.push_back(readKey(sheet, firstRow, count, key));
+    }
+
+    std::vector<int> order(count);
+    for (int k = 0; k < count; k++)
+    {
+        order[k] = k;
+    }
+    parallelStableSort(order, [&columns](int a, int b) {
+        for (const KeyColumn &column : columns)
+        {
+            int result = compareKey(column, a, b);
+            if (result != 0)
+                return result < 0;
+        }
+        return false;
+    });
+
+    applyOrder(sheet, firstRow, order, book);
+}
+
+int filterRows(Spreadsheet &sheet, int firstRow, int lastRow,
+               const std::function<bool(const Spreadsheet &sheet, int row)> &predicate, Workbook *book)
+{
+    int count = prepareRange(sheet, firstRow, lastRow);
+    std::vector<int> order, rejected;
+    for (int k = 0; k < count; k++)
+    {
+        (predicate(sheet, firstRow + k) ? order : rejected).push_back(k);
+    }
+    int matched = (int)order.size();
+    if (matched < count && matched > 0)
+    {
+        order.insert(order.end(), rejected.begin(), rejected.end());
+        applyOrder(sheet, firstRow, order, book);
+    }
+    return matched;
+}
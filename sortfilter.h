@@ -0,0 +1,25 @@
+#ifndef SORTFILTER_H
+#define SORTFILTER_H
+#include <functional>
+#include <vector>
+#include "sheet.h"
+
+class Workbook;
+
+struct SortKey
+{
+    int column;
+    bool descending = false;
+};
+
+// Stable sort of rows firstRow..lastRow by the key columns, numbers before text before
+// empty cells. Whole rows are moved; formulas referring to a moved cell are updated to
+// follow it (in every sheet of book when one is given) and the sheet is recalculated.
+void sortRows(Spreadsheet &sheet, int firstRow, int lastRow, const std::vector<SortKey> &keys, Workbook *book = nullptr);
+
+// Move the rows of firstRow..lastRow that match predicate to the top of the range and the
+// others below them, both keeping their order. Returns how many rows matched.
+int filterRows(Spreadsheet &sheet, int firstRow, int lastRow,
+               const std::function<bool(const Spreadsheet &sheet, int row)> &predicate, Workbook *book = nullptr);
+
+#endif
@@ -0,0 +1,93 @@
+// libFuzzer target for the formula engine and the text it parses. Each input line is typed
+// into the next cell of two 8-column sheets that may refer to each other, which are then
+// recalculated, evaluated again by parseGrid and sorted. Along the way every line is also
+// parsed as an address, a range and a number, and its references are rewritten.
+// Crashes and sanitizer reports are the findings; the only value checked is that a parsed
+// number survives formatNumber and parseNumber unchanged.
+//
+// Build: clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -I. tools/formula_fuzzer.cpp $(ls *.cpp | grep -v main.cpp) -o formula_fuzzer
+// Replay without libFuzzer: add -DFUZZ_STANDALONE (works with g++) and pass input files.
+#include "bulkedit.h"
+#include "formulaparser.h"
+#include "numberformat.h"
+#include "sortfilter.h"
+#include "workbook.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#define FUZZ_COLUMNS 8
+#define FUZZ_MAX_CELLS 128 // Lines past this are ignored, larger sheets find nothing new
+
+static void checkText(std::string_view line)
+{
+    CellAddress address;
+    CellRange range;
+    CellAddress::parse(line, address);
+    CellRange::parse(line, range);
+
+    double number, again;
+    if (parseNumber(line, number) && std::isfinite(number))
+    {
+        std::string text = formatNumber(number);
+        if (!parseNumber(text, again) || std::memcmp(&number, &again, sizeof(double)) != 0)
+        {
+            abort(); // The display text of a number must read back as the same number
+        }
+    }
+
+    forEachReference(line, [](size_t, size_t, const CellAddress &, std::string_view, bool) {});
+    rewriteReferences(line, [](const CellAddress &address, std::string_view, bool corner) {
+        return CellAddress(address.row() + (corner ? 0 : 1), address.column() + 1, address.absoluteRow(),
+                           address.absoluteColumn());
+    });
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    std::string_view input(reinterpret_cast<const char *>(data), size);
+    Workbook book;
+    Spreadsheet &first = book.addSheet("Sheet1");
+    Spreadsheet &second = book.addSheet("Sheet2");
+    BulkEdit edit(first, &book);
+
+    int cell = 0;
+    while (!input.empty() && cell < FUZZ_MAX_CELLS)
+    {
+        size_t end = input.find('\n');
+        std::string line(input.substr(0, end));
+        input.remove_prefix(end == std::string_view::npos ? input.size() : end + 1);
+
+        checkText(line);
+        int row = cell / FUZZ_COLUMNS, col = cell % FUZZ_COLUMNS;
+        edit.setCell(row, col, line);                    // Staged, recalculated by commit
+        second.getCell(col, row).setexpression(line);    // Transposed so the sheets differ
+        cell++;
+    }
+    edit.commit();
+    book.recalculate();
+
+    formulaparser(&book).parseGrid(first);
+    formulaparser(&book).parseGrid(second);
+    sortRows(first, 0, first.totalrows - 1, {SortKey{0}, SortKey{1, true}}, &book);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include <fstream>
+#include <iterator>
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,402 @@
+// Differential tester for the formula engine. Random sheets are computed by the reference,
+// formulaparser::parseGrid run until no value changes, and by the dependency-driven paths
+// (formulaparser::recalculate and Workbook + BulkEdit), first in full and then after a few
+// inputs change. Formulas also read cells below them or to their right, so grid order is not
+// enough and the dependency order is exercised. Sheets whose formulas form a cycle have no
+// single answer and are skipped; the generator avoids them, the check is a safeguard.
+// Every cell whose value differs is printed with the seed that reproduces it.
+//
+// With --throughput, pathological formulas (deep parentheses, huge ranges, long operand
+// chains, ...) are timed instead and any evaluation slower than the limit is reported.
+//
+// Build: g++ -std=c++17 -O2 -pthread -I. tools/formuladiff.cpp $(ls *.cpp | grep -v main.cpp) -o formuladiff
+// Usage: formuladiff [seed=1] [sheets=1000] [rows=24] [columns=6]
+//        formuladiff --throughput [limit ms=50]
+#include "bulkedit.h"
+#include "formulaparser.h"
+#include "workbook.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+#define MAX_REPORTED 20 // Mismatches printed before the rest are only counted
+#define PLACEMENT_TRIES 8 // Random references tried before a formula settles for a constant
+
+// Every formula gets a random rank and only reads formulas of a lower rank, so references
+// point in every direction, also below and to the right, and still never form a cycle
+class SheetGenerator
+{
+private:
+    std::mt19937 random;
+    int rows, cols;
+    std::vector<int> kind, rank; // Per cell: what input() makes of it, and its formula rank
+    int self = 0;                // The cell input() is writing
+
+    int below(int n) { return (int)(random() % n); }
+
+    std::string oneOf(std::initializer_list<const char *> choices)
+    {
+        return *(choices.begin() + below((int)choices.size()));
+    }
+
+    std::string number()
+    {
+        if (below(3) == 0)
+            return std::to_string(below(100)) + "." + std::to_string(below(100));
+        return std::to_string(below(100));
+    }
+
+    std::string address(int row, int col)
+    {
+        std::string text = CellAddress(row, col, below(6) == 0, below(6) == 0).toString();
+        if (below(4) == 0)
+        {
+            for (char &ch : text)
+                ch = (char)tolower((unsigned char)ch);
+        }
+        return text;
+    }
+
+    bool isFormula(int cell) const { return kind[cell] >= 6; }
+
+    // The formula at self may read every cell in rows first..last, columns left..right
+    bool readable(int first, int last, int left, int right) const
+    {
+        for (int i = first; i <= last; i++)
+        {
+            for (int j = left; j <= right; j++)
+            {
+                int cell = i * cols + j;
+                if (isFormula(cell) && rank[cell] >= rank[self])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // A readable range somewhere in the sheet, within column if it is given
+    std::string range(int column = -1)
+    {
+        for (int tries = 0; tries < PLACEMENT_TRIES; tries++)
+        {
+            int first = below(rows), last = first + below(rows - first);
+            int left = column >= 0 ? column : below(cols);
+            int right = column >= 0 ? column : left + below(cols - left);
+            if (readable(first, last, left, right))
+                return address(first, left) + ".." + address(last, right);
+        }
+        // Rows past the sheet are empty, and empty cells may always be read
+        int left = column >= 0 ? column : 0, right = column >= 0 ? column : cols - 1;
+        return address(rows, left) + ".." + address(rows + 1, right);
+    }
+
+    std::string term()
+    {
+        switch (below(5))
+        {
+        case 0:
+            return number();
+        case 1:
+        {
+            for (int tries = 0; tries < PLACEMENT_TRIES; tries++)
+            {
+                int cell = below(rows * cols);
+                if (readable(cell / cols, cell / cols, cell % cols, cell % cols))
+                    return address(cell / cols, cell % cols);
+            }
+            return number();
+        }
+        case 2:
+        case 3:
+            return oneOf({"SUM", "sum", "MAX", "min", "AVER", "STDDEV", "COUNT"}) + "(" + range() + ")";
+        default:
+        {
+            std::string key = below(2) ? number() : "\"" + oneOf({"apple", "Pear", "PLUM"}) + "\"";
+            std::string criterion = below(3) ? key : "\"" + oneOf({"<", "<=", ">", ">=", "<>", "="}) +
+                                                     (below(2) ? number() : oneOf({"apple", "m"})) + "\"";
+            switch (below(4))
+            {
+            case 0:
+                return "COUNTIF(" + range() + "," + criterion + ")";
+            case 1:
+            {
+                std::string columnRange = range(below(cols));
+                return "SUMIF(" + columnRange + "," + criterion + "," + columnRange + ")";
+            }
+            case 2:
+                return "MATCH(" + key + "," + range(below(cols)) + oneOf({"", ",0", ",1", ",-1"}) + ")";
+            default:
+                return "VLOOKUP(" + key + "," + range() + "," + std::to_string(below(3) + 1) +
+                       oneOf({"", ",FALSE", ",TRUE", ",1"}) + ")";
+            }
+        }
+        }
+    }
+
+public:
+    SheetGenerator(unsigned seed, int rowCount, int colCount) : random(seed), rows(rowCount), cols(colCount)
+    {
+        for (int cell = 0; cell < rows * cols; cell++)
+        {
+            kind.push_back(below(10));
+            rank.push_back(cell);
+        }
+        std::shuffle(rank.begin(), rank.end(), random);
+    }
+
+    std::string literal()
+    {
+        return below(5) == 0 ? oneOf({"apple", "Pear", "plum", ""}) : number();
+    }
+
+    // What the user types into a cell: empty, a literal or a formula over lower ranked formulas
+    std::string input(int row, int col)
+    {
+        self = row * cols + col;
+        if (kind[self] < 2)
+            return "";
+        if (!isFormula(self))
+            return literal();
+        std::string formula = "=" + term();
+        for (int terms = below(4); terms > 0; terms--)
+        {
+            formula += oneOf({"+", "-", "*", "/"}) + term();
+        }
+        return formula;
+    }
+
+    int pick(int n) { return below(n); }
+};
+
+static void setInput(Spreadsheet &sheet, int row, int col, const std::string &text)
+{
+    Cell &cell = sheet.getCell(row, col);
+    bool formula = !text.empty() && text[0] == '=';
+    cell.setexpression(formula ? text : "");
+    cell.setvalue(formula ? "" : text);
+}
+
+// Recalculate in grid order until nothing changes, which for a sheet without cycles
+// gives every formula the value of its inputs however they are ordered
+static void settle(Spreadsheet &sheet)
+{
+    std::vector<std::string> before;
+    for (int pass = 0; pass <= sheet.totalrows * sheet.totalcols; pass++)
+    {
+        std::vector<std::string> values;
+        formulaparser().parseGrid(sheet);
+        for (int i = 0; i < sheet.totalrows; i++)
+        {
+            for (int j = 0; j < sheet.totalcols; j++)
+                values.push_back(((const Spreadsheet &)sheet).getCell(i, j).getvalue());
+        }
+        if (values == before)
+            return;
+        before.swap(values);
+    }
+}
+
+// True if some formula depends on itself through the cells and ranges it reads
+static bool hasCycle(const Spreadsheet &sheet)
+{
+    int rows = sheet.totalrows, cols = sheet.totalcols;
+    std::vector<std::vector<int>> reads(rows * cols);
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            const std::string &expression = sheet.getCell(i, j).getexpression();
+            if (expression.empty() || expression[0] != '=')
+                continue;
+            for (const CellRange &range : formulaparser().collectReferences(expression))
+            {
+                for (int r = range.first.row(); r <= std::min(range.last.row(), rows - 1); r++)
+                    for (int c = range.first.column(); c <= std::min(range.last.column(), cols - 1); c++)
+                        reads[i * cols + j].push_back(r * cols + c);
+            }
+        }
+    }
+    std::vector<int> state(rows * cols); // 0 not seen, 1 on the current path, 2 done
+    std::function<bool(int)> visit = [&](int cell) {
+        state[cell] = 1;
+        for (int next : reads[cell])
+        {
+            if (state[next] == 1 || (state[next] == 0 && visit(next)))
+                return true;
+        }
+        state[cell] = 2;
+        return false;
+    };
+    for (int cell = 0; cell < rows * cols; cell++)
+    {
+        if (state[cell] == 0 && visit(cell))
+            return true;
+    }
+    return false;
+}
+
+// Print the cells where sheet disagrees with the reference; returns how many there were
+static int compare(const Spreadsheet &reference, const Spreadsheet &sheet, const char *engine, unsigned seed,
+                   int &reported)
+{
+    int mismatches = 0;
+    for (int i = 0; i < reference.totalrows; i++)
+    {
+        for (int j = 0; j < reference.totalcols; j++)
+        {
+            const Cell &expected = reference.getCell(i, j), &actual = sheet.getCell(i, j);
+            if (expected.getvalue() == actual.getvalue())
+                continue;
+            mismatches++;
+            if (reported++ < MAX_REPORTED)
+            {
+                printf("seed %u %s %s: %s\n  reference \"%s\", got \"%s\"\n", seed, engine,
+                       CellAddress(i, j).toString().c_str(), expected.getexpression().c_str(),
+                       expected.getvalue().c_str(), actual.getvalue().c_str());
+            }
+        }
+    }
+    return mismatches;
+}
+
+// Build one random sheet, compute it every way, change some literals and compare again.
+// Sheets with a cycle are counted in skipped and not compared.
+static int runDifferential(unsigned seed, int rows, int cols, int &reported, int &skipped)
+{
+    SheetGenerator generator(seed, rows, cols);
+    Spreadsheet reference(rows, cols), dependent(rows, cols);
+    Workbook book;
+    Spreadsheet &booked = book.addSheet("Sheet1", rows, cols);
+    std::vector<CellAddress> cells, literals;
+
+    BulkEdit edit(booked, &book);
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            std::string text = generator.input(i, j);
+            setInput(reference, i, j, text);
+            setInput(dependent, i, j, text);
+            edit.setCell(i, j, text);
+            cells.push_back(CellAddress(i, j));
+            if (text.empty() || text[0] != '=')
+                literals.push_back(CellAddress(i, j));
+        }
+    }
+    if (hasCycle(reference))
+    {
+        skipped++;
+        return 0;
+    }
+    settle(reference);
+    formulaparser().recalculate(dependent, cells);
+    edit.commit();
+
+    int mismatches = compare(reference, dependent, "recalculate", seed, reported) +
+                     compare(reference, booked, "workbook", seed, reported);
+    if (literals.empty())
+        return mismatches;
+
+    // Only the changed cells are handed to the incremental paths
+    std::vector<CellAddress> changed;
+    BulkEdit change(booked, &book);
+    for (int k = generator.pick(4) + 1; k > 0; k--)
+    {
+        CellAddress address = literals[generator.pick((int)literals.size())];
+        std::string text = generator.literal();
+        setInput(reference, address.row(), address.column(), text);
+        setInput(dependent, address.row(), address.column(), text);
+        change.setCell(address.row(), address.column(), text);
+        changed.push_back(address);
+    }
+    settle(reference);
+    formulaparser().recalculate(dependent, changed);
+    change.commit();
+
+    return mismatches + compare(reference, dependent, "recalculate after edit", seed, reported) +
+           compare(reference, booked, "workbook after edit", seed, reported);
+}
+
+// Inputs known to be hard on a text-rewriting evaluator
+static std::vector<std::pair<std::string, std::string>> pathologicalFormulas()
+{
+    std::vector<std::pair<std::string, std::string>> cases;
+    const int depth = 10000, terms = 20000;
+    cases.push_back({"nested parentheses", "=" + std::string(depth, '(') + "1" + std::string(depth, ')')});
+    cases.push_back({"unclosed parentheses", "=SUM" + std::string(depth, '(') + "A1"});
+    cases.push_back({"whole sheet range", "=SUM(A1..XFD1048576)"});
+    cases.push_back({"whole column range", "=AVER(A1..A1048576)+STDDEV(B1..B1048576)"});
+    cases.push_back({"whole row countif", "=COUNTIF(A1..XFD1,1)"});
+
+    std::string chain = "=A1", calls = "=SUM(A1..A2)", names = "=";
+    for (int i = 1; i < terms; i++)
+    {
+        chain += "+A" + std::to_string(i % 100 + 1);
+        calls += "+SUM(A1..A2)";
+        names += "ABCDEFGH";
+    }
+    cases.push_back({"long operand chain", chain});
+    cases.push_back({"many function calls", calls});
+    cases.push_back({"long letter run", names + "(1)"});
+    cases.push_back({"nested calls", "=" + [&] {
+                         std::string nested = "A1";
+                         for (int i = 0; i < depth; i++)
+                             nested = "SUM(" + nested + ")";
+                         return nested;
+                     }()});
+    return cases;
+}
+
+static int runThroughput(double limitMs)
+{
+    int slow = 0;
+    for (const auto &[name, formula] : pathologicalFormulas())
+    {
+        Spreadsheet sheet;
+        for (int i = 0; i < 100; i++)
+        {
+            sheet.getCell(i, 0).setvalue(std::to_string(i));
+            sheet.getCell(i, 1).setvalue(std::to_string(i % 7));
+        }
+        sheet.getCell(200, 3).setexpression(formula);
+
+        Clock::time_point start = Clock::now();
+        formulaparser().evaluateCell(200, 3, sheet);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        bool tooSlow = ms > limitMs;
+        slow += tooSlow;
+        printf("%-22s %8zu chars %10.2f ms%s\n", name.c_str(), formula.size(), ms, tooSlow ? "  SLOW" : "");
+    }
+    return slow ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--throughput")
+    {
+        return runThroughput(argc > 2 ? atof(argv[2]) : 50.0);
+    }
+
+    unsigned seed = argc > 1 ? (unsigned)atoi(argv[1]) : 1;
+    int sheets = argc > 2 ? atoi(argv[2]) : 1000;
+    int rows = argc > 3 ? std::max(1, atoi(argv[3])) : 24;
+    int cols = argc > 4 ? std::max(1, atoi(argv[4])) : 6;
+
+    int mismatches = 0, reported = 0, skipped = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < sheets; i++)
+    {
+        mismatches += runDifferential(seed + i, rows, cols, reported, skipped);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%d sheets of %dx%d, seeds %u..%u: %d mismatching cells, %d cyclic sheets skipped (%.2f s)\n", sheets,
+           rows, cols, seed, seed + sheets - 1, mismatches, skipped, seconds);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+// Load generator for the compute server (spreadsheet --serve <socket>).
+// Each client sends batches of pipelined SETs followed by a GET and times each batch.
+// Build: g++ -std=c++17 -O2 -pthread tools/loadgen.cpp -o loadgen
+// Usage: loadgen <socket> [clients=4] [batches=1000] [batch size=32]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static int connectTo(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+// Run one client; appends the latency of every batch in microseconds
+static void runClient(const char *path, int id, int batches, int batchSize, std::vector<double> &latencies)
+{
+    int fd = connectTo(path);
+    std::mt19937 random(id);
+    std::string request, reply;
+    char buffer[65536];
+
+    // Every client works on its own workbook so they do not overwrite each other
+    request = "USE load" + std::to_string(id) + "\n";
+    write(fd, request.data(), request.size());
+    read(fd, buffer, sizeof(buffer));
+
+    for (int b = 0; b < batches; b++)
+    {
+        request.clear();
+        for (int k = 0; k < batchSize - 1; k++)
+        {
+            int row = random() % 1000 + 1;
+            char col = 'A' + random() % 8;
+            if (k % 8 == 7)
+                request += "SET " + std::string(1, col) + std::to_string(row) + " =SUM(A1..H20)+A1*2\n";
+            else
+                request += "SET " + std::string(1, col) + std::to_string(row) + " " + std::to_string(random() % 10000) + "\n";
+        }
+        request += "GET A1..H2\n";
+
+        Clock::time_point start = Clock::now();
+        for (size_t sent = 0; sent < request.size();)
+        {
+            ssize_t length = write(fd, request.data() + sent, request.size() - sent);
+            if (length <= 0)
+            {
+                perror("write");
+                exit(1);
+            }
+            sent += length;
+        }
+        int lines = 0;
+        while (lines < batchSize)
+        {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0)
+            {
+                fprintf(stderr, "Server closed the connection\n");
+                exit(1);
+            }
+            lines += std::count(buffer, buffer + length, '\n');
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <socket> [clients] [batches] [batch size]\n", argv[0]);
+        return 1;
+    }
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    int batches = argc > 3 ? atoi(argv[3]) : 1000;
+    int batchSize = argc > 4 ? std::max(1, atoi(argv[4])) : 32;
+
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < clients; i++)
+    {
+        threads.emplace_back(runClient, argv[1], i, batches, batchSize, std::ref(latencies[i]));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const std::vector<double> &list : latencies)
+    {
+        all.insert(all.end(), list.begin(), list.end());
+    }
+    std::sort(all.begin(), all.end());
+    if (all.empty())
+    {
+        return 0;
+    }
+    double requests = (double)all.size() * batchSize;
+    printf("clients %d, batches %zu, requests per batch %d\n", clients, all.size(), batchSize);
+    printf("batch latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           all[all.size() / 2], all[std::min(all.size() - 1, all.size() * 99 / 100)], all.back());
+    printf("throughput %.0f requests/s in %.2f s\n", requests / seconds, seconds);
+    return 0;
+}
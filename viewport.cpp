@@ -0,0 +1,42 @@
+#include "viewport.h"
+
+// The classic layout: INIT_ROW rows of INIT_COLUMN columns until the terminal size is known
+Viewport::Viewport()
+    : screenRows(INIT_ROW + GRID_TOP - 1), screenCols(4 + INIT_COLUMN * col_width),
+      rows(INIT_ROW), cols(INIT_COLUMN), labelWidth(3), topRow(0), leftCol(0), cursorRow(0), cursorCol(0)
+{
+}
+
+void Viewport::fitTerminal(int termRows, int termCols)
+{
+    screenRows = termRows;
+    screenCols = termCols;
+    layout();
+}
+
+// Size the grid for the screen and scroll just enough to keep the cursor on it
+void Viewport::layout()
+{
+    rows = std::max(1, std::min(screenRows - (GRID_TOP - 1), MAX_ROWS));
+    topRow = std::max(0, std::min({topRow, cursorRow, MAX_ROWS - rows}));
+    topRow = std::max(topRow, cursorRow - rows + 1);
+
+    labelWidth = std::max(3, (int)std::to_string(topRow + rows).size());
+    cols = std::max(1, std::min((screenCols - labelWidth - 1) / col_width, MAX_COLUMNS));
+    leftCol = std::max(0, std::min({leftCol, cursorCol, MAX_COLUMNS - cols}));
+    leftCol = std::max(leftCol, cursorCol - cols + 1);
+}
+
+bool Viewport::moveCursor(int rowDelta, int colDelta)
+{
+    return goTo(cursorRow + rowDelta, cursorCol + colDelta);
+}
+
+bool Viewport::goTo(int row, int col)
+{
+    int top = topRow, left = leftCol, label = labelWidth;
+    cursorRow = std::max(0, std::min(row, MAX_ROWS - 1));
+    cursorCol = std::max(0, std::min(col, MAX_COLUMNS - 1));
+    layout();
+    return topRow != top || leftCol != left || labelWidth != label;
+}
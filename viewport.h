@@ -0,0 +1,31 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "AnsiTerminal.h"
+#include "celladdress.h"
+
+#define GRID_TOP 5 // Screen row of the first sheet row, the lines above hold the address, value and column names
+
+// The part of the sheet shown on screen and the selected cell.
+// Drawing reads only the cells inside it, so a sheet of a million rows scrolls like an empty one.
+class Viewport
+{
+private:
+    int screenRows, screenCols; // Terminal size the grid was fitted to
+    void layout();
+
+public:
+    Viewport();
+    int rows, cols;           // Sheet rows and columns that fit on the screen
+    int labelWidth;           // Width of the row numbers, grows with the largest one shown
+    int topRow, leftCol;      // Sheet position of the top left cell on screen
+    int cursorRow, cursorCol; // Selected cell, always on screen
+    void fitTerminal(int termRows, int termCols);
+    bool moveCursor(int rowDelta, int colDelta); // true if the view scrolled
+    bool goTo(int row, int col);                 // true if the view scrolled
+    int width() const { return labelWidth + 1 + cols * col_width; }
+    int screenRow(int row) const { return GRID_TOP + row - topRow; }
+    int screenCol(int col) const { return labelWidth + 1 + (col - leftCol) * col_width; }
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "workbook.h"
+#include "formulaparser.h"
+#include <algorithm>
+#include <cctype>
+#include <future>
+#include <stdexcept>
+
+Spreadsheet &Workbook::addSheet(const std::string &name, int row, int col)
+{
+    if (!isSheetName(name))
+    {
+        throw std::invalid_argument("Invalid sheet name: " + name);
+    }
+    names.push_back(name);
+    sheets.push_back(std::make_unique<Spreadsheet>(row, col));
+    references.emplace_back();
+    hasFormulas.push_back(false);
+    return *sheets.back();
+}
+
+int Workbook::findSheet(std::string_view name) const
+{
+    for (int i = 0; i < (int)names.size(); i++)
+    {
+        const std::string &candidate = names[i];
+        if (candidate.size() == name.size() &&
+            std::equal(candidate.begin(), candidate.end(), name.begin(),
+                       [](char a, char b) { return toupper((unsigned char)a) == toupper((unsigned char)b); }))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Workbook::indexOf(const Spreadsheet &sheet) const
+{
+    for (int i = 0; i < (int)sheets.size(); i++)
+    {
+        if (sheets[i].get() == &sheet)
+            return i;
+    }
+    return -1;
+}
+
+Spreadsheet *Workbook::findSheetByName(std::string_view name)
+{
+    int index = findSheet(name);
+    return index < 0 ? nullptr : sheets[index].get();
+}
+
+MemoryUsage Workbook::memoryUsage() const
+{
+    MemoryUsage usage;
+    for (size_t i = 0; i < sheets.size(); i++)
+    {
+        usage += sheets[i]->memoryUsage();
+        usage.caches += sizeof(names[i]) + stringHeapBytes(names[i]) + sizeof(references[i]) +
+                        references[i].capacity() * sizeof(int);
+    }
+    usage.caches += hasFormulas.capacity() / 8;
+    return usage;
+}
+
+// Find which sheets the formulas of a changed sheet read from
+void Workbook::scanFormulas(int index)
+{
+    const Spreadsheet &sheet = *sheets[index];
+    std::vector<int> &targets = references[index];
+    targets.clear();
+    hasFormulas[index] = false;
+
+    for (int i = 0; i < sheet.totalrows; i++)
+    {
+        int allocated = std::min(sheet.totalcols, (int)sheet.getRow(i).size()); // Cells never written hold no formula
+        for (int j = 0; j < allocated; j++)
+        {
+            const Cell *cell = sheet.findCell(i, j);
+            if (!cell || cell->getexpression().empty() || cell->getexpression()[0] != '=')
+                continue;
+            hasFormulas[index] = true;
+
+            // Every "Name!" prefix names a sheet this one reads from
+            forEachReference(cell->getexpression(), [&](size_t, size_t, const CellAddress &, std::string_view name, bool) {
+                int target = name.empty() ? -1 : findSheet(name);
+                if (target >= 0 && target != index && std::find(targets.begin(), targets.end(), target) == targets.end())
+                {
+                    targets.push_back(target);
+                }
+            });
+        }
+    }
+}
+
+void Workbook::recalculate()
+{
+    recalculateSheets(-1);
+}
+
+void Workbook::recalculate(Spreadsheet &sheet, const std::vector<CellAddress> &cells)
+{
+    int index = indexOf(sheet);
+    if (index < 0)
+    {
+        throw std::invalid_argument("Sheet is not part of this workbook");
+    }
+    formulaparser(this).recalculate(sheet, cells);
+    recalculateSheets(index);
+}
+
+// Recalculate changed sheets and their readers; the sheet at index updated (if any)
+// has already been brought up to date and only counts as changed for its readers
+void Workbook::recalculateSheets(int updated)
+{
+    int count = sheetCount();
+    std::vector<bool> changed(count), needed(count);
+    for (int i = 0; i < count; i++)
+    {
+        changed[i] = sheets[i]->isDirty();
+        if (changed[i])
+        {
+            scanFormulas(i);
+            needed[i] = hasFormulas[i] && i != updated;
+        }
+    }
+
+    // A sheet reading from a changed or recalculated sheet is recalculated too
+    for (bool grew = true; grew;)
+    {
+        grew = false;
+        for (int i = 0; i < count; i++)
+        {
+            if (needed[i])
+                continue;
+            for (int target : references[i])
+            {
+                if (changed[target] || needed[target])
+                {
+                    needed[i] = grew = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Run in waves: a sheet starts once every needed sheet it reads from is done
+    std::vector<bool> done(count);
+    for (int i = 0; i < count; i++)
+    {
+        done[i] = !needed[i];
+    }
+    for (int remaining = (int)std::count(needed.begin(), needed.end(), true); remaining > 0;)
+    {
+        std::vector<int> wave;
+        for (int i = 0; i < count; i++)
+        {
+            if (done[i])
+                continue;
+            bool ready = true;
+            for (int target : references[i])
+            {
+                ready = ready && done[target];
+            }
+            if (ready)
+                wave.push_back(i);
+        }
+
+        if (wave.empty())
+        {
+            // Sheets reading from each other in a cycle: compute them one by one
+            for (int i = 0; i < count; i++)
+            {
+                if (!done[i])
+                {
+                    formulaparser(this).parseGrid(*sheets[i]);
+                    wave.push_back(i);
+                }
+            }
+        }
+        else if (wave.size() == 1)
+        {
+            formulaparser(this).parseGrid(*sheets[wave[0]]);
+        }
+        else
+        {
+            // Sheets in one wave never read from each other, so they can run concurrently
+            std::vector<std::future<void>> tasks;
+            for (int i : wave)
+            {
+                tasks.push_back(std::async(std::launch::async, [this, i]() {
+                    formulaparser(this).parseGrid(*sheets[i]);
+                }));
+            }
+            for (std::future<void> &task : tasks)
+            {
+                task.get();
+            }
+        }
+
+        for (int i : wave)
+        {
+            done[i] = true;
+        }
+        remaining -= (int)wave.size();
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        sheets[i]->clearDirty();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef WORKBOOK_H
+#define WORKBOOK_H
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "sheet.h"
+#include "celladdress.h"
+
+// A set of named sheets whose formulas may refer to each other as "Sheet2!A1"
+class Workbook
+{
+private:
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<Spreadsheet>> sheets;
+    std::vector<std::vector<int>> references; // Sheets each sheet's formulas read from
+    std::vector<bool> hasFormulas;
+
+    void scanFormulas(int index);
+    void recalculateSheets(int updated);
+
+public:
+    // Throws std::invalid_argument unless isSheetName(name), so formulas can refer to the sheet
+    Spreadsheet &addSheet(const std::string &name, int row = INIT_ROW, int col = INIT_COLUMN);
+    int sheetCount() const { return (int)sheets.size(); }
+    Spreadsheet &getSheet(int index) { return *sheets.at(index); }
+    const Spreadsheet &getSheet(int index) const { return *sheets.at(index); }
+    const std::string &sheetName(int index) const { return names.at(index); }
+    int findSheet(std::string_view name) const; // Case-insensitive, -1 if there is no such sheet
+    int indexOf(const Spreadsheet &sheet) const; // -1 if the sheet belongs to another workbook
+    Spreadsheet *findSheetByName(std::string_view name);
+    MemoryUsage memoryUsage() const; // All sheets, plus the dependencies between them as caches
+
+    // Recalculate changed sheets and the sheets reading from them. Sheets that do not
+    // depend on each other are computed concurrently; untouched sheets are skipped.
+    void recalculate();
+
+    // Same, after only the given cells of sheet changed: that sheet recomputes just the
+    // formulas depending on them, the sheets reading from it are recomputed as above
+    void recalculate(Spreadsheet &sheet, const std::vector<CellAddress> &cells);
+};
+
+#endif